@@ -0,0 +1,59 @@
+/*! \file adc_queue.c
+    \brief Lock-free queue of raw ADC blocks from _DMA1Interrupt() to the main loop
+
+    Single producer (the DMA1 ISR) and single consumer (temperature_task()).
+    The producer only ever writes adc_queue_head and the consumer only ever
+    writes adc_queue_tail, and both are 8 bit so every access is atomic.
+    Neither side needs to disable interrupts.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "adc_queue.h"
+
+static volatile adcRecord adc_queue[ADC_QUEUE_LENGTH];
+static volatile unsigned char adc_queue_head = 0; ///next slot the ISR writes
+static volatile unsigned char adc_queue_tail = 0; ///next slot the main loop reads
+volatile unsigned int adc_queue_overflows = 0; ///records dropped because the queue was full
+
+/*! \brief Appends a record (call from the ISR only)
+ */
+
+unsigned char adc_queue_push(adcRecord *pRecord) {
+    unsigned char head = adc_queue_head;
+    unsigned char inc;
+
+    if((unsigned char)(head - adc_queue_tail) >= ADC_QUEUE_LENGTH) {
+        adc_queue_overflows++;
+        return 1; /*! \return 1 = queue full, record dropped */
+    }
+
+    adc_queue[head & (ADC_QUEUE_LENGTH-1)].timestamp = pRecord->timestamp;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        adc_queue[head & (ADC_QUEUE_LENGTH-1)].accum[inc] = pRecord->accum[inc];
+    }
+    adc_queue_head = head + 1; //publish only after the record is complete
+
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Removes the oldest record (call from the main loop only)
+ */
+
+unsigned char adc_queue_pop(adcRecord *pRecord) {
+    unsigned char tail = adc_queue_tail;
+    unsigned char inc;
+
+    if(tail == adc_queue_head) {
+        return 1; /*! \return 1 = queue empty */
+    }
+
+    pRecord->timestamp = adc_queue[tail & (ADC_QUEUE_LENGTH-1)].timestamp;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pRecord->accum[inc] = adc_queue[tail & (ADC_QUEUE_LENGTH-1)].accum[inc];
+    }
+    adc_queue_tail = tail + 1; //release the slot only after it has been copied
+
+    return 0; /*! \return 0 = success */
+}
@@ -0,0 +1,17 @@
+
+#ifndef INC_ADC_QUEUE_H
+#define INC_ADC_QUEUE_H
+
+#define ADC_QUEUE_LENGTH 16 ///records in the ISR -> main loop queue (power of 2)
+
+typedef struct adcRecord {
+    unsigned long timestamp; //timebase_read() when the block completed
+    unsigned int accum[ADC_NUM_CHANNELS]; //block sums indexed by T0_PROBE..T2_PROBE
+}adcRecord;
+
+extern volatile unsigned int adc_queue_overflows;
+
+unsigned char adc_queue_push(adcRecord *pRecord);
+unsigned char adc_queue_pop(adcRecord *pRecord);
+
+#endif
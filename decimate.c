@@ -0,0 +1,95 @@
+/*! \file decimate.c
+    \brief Per-channel oversampling/decimation filter for the ADC block sums
+
+    Each DMA block already holds the sum of ADC_BLOCK_LENGTH conversions per
+    probe. decimate_push() is fed one block sum at a time from
+    temperature_task() and adds it to a boxcar (a first order CIC) until
+    ratio/ADC_BLOCK_LENGTH blocks have been seen. The boxcar output is then
+    smoothed by a short FIR evaluated on the DSP engine (MPY/MAC into
+    accumulator A), so each channel produces one reading every ratio
+    conversions at a steady rate and with the noise averaged down.
+
+    The boxcar puts nulls at multiples of the output rate, the FIR rolls off
+    what leaks through between them (pump motor noise on the thermocouple).
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "decimate.h"
+
+/* Binomial FIR on the boxcar outputs, Q15, sums to 1.0 so the DC gain is
+ * exactly one. */
+static const int decimate_fir[DECIMATE_FIR_TAPS] = {4096, 12288, 12288, 4096};
+
+/*! \brief Sets up a channel's filter
+ *
+ *  ratio is the number of conversions per output and must be a power of 2
+ *  between DECIMATE_RATIO_MIN and DECIMATE_RATIO_MAX.
+ */
+
+unsigned char decimate_init(decimateStage *pStage, unsigned int ratio) {
+    unsigned char shift = 0;
+
+    if(ratio < DECIMATE_RATIO_MIN || ratio > DECIMATE_RATIO_MAX || (ratio & (ratio - 1)) != 0) {
+        return 1; /*! \return 1 = ratio not supported */
+    }
+
+    while((ADC_BLOCK_LENGTH << shift) < ratio) {
+        shift++;
+    }
+
+    pStage->sum = 0;
+    pStage->count = 0;
+    pStage->blocks = 1 << shift;
+    pStage->shift = shift;
+    pStage->primed = 0;
+
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Adds one DMA block sum to a channel's filter
+ *
+ *  The boxcar mean is taken offset binary -> signed so the FIR can use the
+ *  fractional multiplier. Until the first output the FIR history is filled
+ *  with that output so the filter does not ramp up from zero.
+ *
+ *  On success *pOut has the same scale as a single block sum (full scale
+ *  2^16), so it can go straight into the temperature conversions.
+ */
+
+unsigned char decimate_push(decimateStage *pStage, unsigned int adc_accum, unsigned int *pOut) {
+    register int acc asm("A");
+    int mean;
+    unsigned char k;
+
+    pStage->sum += adc_accum;
+    if(++pStage->count < pStage->blocks) {
+        return 1; /*! \return 1 = no output yet */
+    }
+
+    //rounded boxcar mean, offset to signed
+    mean = (int)((unsigned int)((pStage->sum + (pStage->blocks >> 1)) >> pStage->shift) ^ 0x8000);
+    pStage->sum = 0;
+    pStage->count = 0;
+
+    if(!pStage->primed) {
+        for(k = 0; k < DECIMATE_FIR_TAPS; k++) {
+            pStage->history[k] = mean;
+        }
+        pStage->primed = 1;
+    }
+
+    for(k = DECIMATE_FIR_TAPS - 1; k > 0; k--) {
+        pStage->history[k] = pStage->history[k-1];
+    }
+    pStage->history[0] = mean;
+
+    acc = __builtin_mpy(pStage->history[0], decimate_fir[0], 0, 0, 0, 0, 0, 0);
+    for(k = 1; k < DECIMATE_FIR_TAPS; k++) {
+        acc = __builtin_mac(acc, pStage->history[k], decimate_fir[k], 0, 0, 0, 0, 0, 0, 0, 0);
+    }
+
+    *pOut = (unsigned int)__builtin_sacr(acc, 0) ^ 0x8000;
+
+    return 0; /*! \return 0 = output written to *pOut */
+}
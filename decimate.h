@@ -0,0 +1,23 @@
+
+#ifndef INC_DECIMATE_H
+#define INC_DECIMATE_H
+
+#define DECIMATE_RATIO_MIN  16      ///smallest ratio (one DMA block per output)
+#define DECIMATE_RATIO_MAX  1024    ///largest ratio (64 DMA blocks per output)
+#define DECIMATE_FIR_TAPS   4       ///taps of the FIR that follows the boxcar
+
+/* One channel's decimation state: a boxcar over whole DMA blocks followed by
+ * a short FIR on the boxcar outputs. */
+typedef struct decimateStage {
+    unsigned long sum; //boxcar sum of the block sums so far
+    unsigned char count; //blocks in sum
+    unsigned char blocks; //blocks per output (power of 2)
+    unsigned char shift; //log2(blocks)
+    unsigned char primed; //1 once history[] holds real outputs
+    int history[DECIMATE_FIR_TAPS]; //boxcar outputs, newest first, offset to signed
+}decimateStage;
+
+unsigned char decimate_init(decimateStage *pStage, unsigned int ratio);
+unsigned char decimate_push(decimateStage *pStage, unsigned int adc_accum, unsigned int *pOut);
+
+#endif
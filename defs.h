@@ -45,9 +45,9 @@
 /** @defgroup HEATER_PINS HEATER Pins
  * @{ */
 #define HEATER1_DIR     TRISEbits.TRISE3
-#define HEATER1         LATEbits.LATE3
+#define HEATER1         0x08 ///LATE3 bit, switch with HEATER_SET()
 #define HEATER2_DIR     TRISEbits.TRISE4
-#define HEATER2         LATEbits.LATE4
+#define HEATER2         0x10 ///LATE4 bit, switch with HEATER_SET()
 
 /** @} */
 
@@ -64,6 +64,8 @@
  * @{ */
 #define TIMER2_ON		T2CONbits.TON  
 #define TIMER2_PERIOD 	200   //3200 = 12.5KHz 1600 = 25KHz, 800 = 50KHz, 500 = 80KHz, 640 = 62.5Khz
+#define TIMEBASE_TICKS_PER_SECOND (FCY/256) ///Timer4/5 timestamp rate (156.25KHz)
+#define PROFILE_ISR     0 ///1 = measure worst case ISR and log_encode() cycle counts with Timer1 and report them over the UART (debug builds only)
 /** @} */
 
 // R1 Response Codes (from SD Card Product Manual v1.9 section 5.2.3.1)
@@ -77,7 +79,7 @@
 #define R1_ADDRESS_ERROR        (1<<5)  /// A misaligned address, which did not match the block length was used in the command.
 #define R1_PARAMETER            (1<<6)  /// The command's argument (e.g. address, block length) was out of the allowed range for this card.
 #define BLOCK_SIZE              512     ///sd card block size
-#define BUFFER_SIZE             2048  /// size of the circular buffer
+#define BUFFER_SIZE             8192  /// size of the staging memory (819 raw 10 byte samples, over a minute at 10 samples/s; packed only into card blocks)
 #define SD_START_ADDRESS        0      	///leave 10 KB at beginning of card for misc. information
 #define CMD0_TIMEOUT            500    	///CMD0 timeout
 #define CMD8_TIMEOUT            500     ///CMD8 timeout
@@ -87,6 +89,20 @@
 #define START_BLOCK_TIMEOUT     10000   ///CMD17 start block timeout
 #define MULTI_TOKEN_TIMEOUT     1000    ///CMD24 receive token timeout
 #define PRE_ERASE_TIMEOUT       1000	///CMD55 pre-erase timeout
+#define WRITE_BUSY_TIMEOUT      400000UL ///8 bit busy polls after a DMA block (~250ms at a 20MHz SPI clock)
+#define WRITE_BUSY_TIMEOUT16    200000UL ///16 bit busy polls after a block (~250ms at a 20MHz SPI clock)
+#define SD_DMA_LENGTH           (BLOCK_SIZE+3) ///data token + block + 2 CRC bytes streamed to SPI1 by DMA2
+#define SD_DMA_IRQ              0x0A    ///DMAxREQ IRQSEL for SPI1 transfer done
+#define SD_POLLS_PER_TASK       8       ///most bytes sd_async_task() polls per call
+#define SD_CMD_TIMEOUT_TICKS    (TIMEBASE_TICKS_PER_SECOND/10) ///R1 and data response deadline (100ms)
+#define SD_WRITE_TIMEOUT_TICKS  (TIMEBASE_TICKS_PER_SECOND/2)  ///busy deadline per block (spec allows 250ms for SDHC)
+/** @} */
+
+/** @defgroup LOG_DEFS Log Definitions
+ * @{ */
+#define LOG_CODEC_VARINT    0 ///delta and zigzag varint bytes, 5.05 bytes per sample on the simulated week (tools/test_log_codec.c)
+#define LOG_CODEC_GORILLA   1 ///delta-of-delta and delta bitstream, 2.19 to 3.97 bytes per sample on the simulated week (tools/test_log_codec.c)
+#define LOG_CODEC           LOG_CODEC_GORILLA ///payload format of new record blocks
 /** @} */
 
 
@@ -98,12 +114,60 @@
 #define T0_AN  3
 #define T1_AN  4
 #define T2_AN  5
+#define T0_PROBE 0 ///index of T0 in per-probe arrays
+#define T1_PROBE 1 ///index of T1 in per-probe arrays
+#define T2_PROBE 2 ///index of T2 in per-probe arrays
 #define ADC_SOURCE  AD1CHS0bits.CH0SA
 #define ADC1_SAMP AD1CON1bits.SAMP
+#define ADC_NUM_CHANNELS 3 ///number of probes (T0_AN..T2_AN)
+#define ADC_BLOCK_LENGTH 16 ///samples per input in each DMA ping-pong buffer (must match AD1CON4bits.DMABL)
+
+#define ADC_ACQ_SCAN    0 ///12-bit, CH0 scans T0..T2 one after the other
+#define ADC_ACQ_SIMSAM  1 ///10-bit, CH0..CH3 sample T0..T2 at the same instant
+#define ADC_ACQ_MODE    ADC_ACQ_SCAN ///selected acquisition mode
+
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+#define ADC_SIMSAM_CHANNELS 4 ///CH0 (T0), CH1 (T0), CH2 (T1), CH3 (T2)
+#define ADC_DMA_BUF_LENGTH (ADC_SIMSAM_CHANNELS*ADC_BLOCK_LENGTH) ///results stored in conversion order
+#define ADC_DMA_TRANSFERS  (ADC_SIMSAM_CHANNELS*ADC_BLOCK_LENGTH) ///DMA transfers per ping-pong buffer
+#else
+#define ADC_DMA_BUF_LENGTH ((T2_AN+1)*ADC_BLOCK_LENGTH) ///scatter/gather buffer holds one slot per AN input up to T2_AN
+#define ADC_DMA_TRANSFERS  (ADC_NUM_CHANNELS*ADC_BLOCK_LENGTH) ///DMA transfers per ping-pong buffer
+#endif
+
+#define ADC_TRIGGER_AUTO    0 ///convert as soon as SAMC expires (not aligned to the mains)
+#define ADC_TRIGGER_MAINS   1 ///Timer3 paces the conversions so each T0 reading spans whole mains cycles
+#define ADC_TRIGGER         ADC_TRIGGER_MAINS ///selected conversion trigger
+#define MAINS_HZ            50 ///local mains frequency (50 or 60)
+#define MAINS_CYCLES        5 ///mains cycles integrated into each T0 reading (5 = 100ms at 50Hz, 83ms at 60Hz)
+#define ADC_CONVERT_CYCLES  (15*64) ///shortest trigger period: 1 TAD sample + 14 TAD conversion at T_AD = 64 TCY
+
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+#define ADC_TRIGGERS_PER_SCAN 1 ///one trigger samples every probe
+#else
+#define ADC_TRIGGERS_PER_SCAN ADC_NUM_CHANNELS ///one trigger per scanned input
+#endif
+
+/* Timer3 period (TCY) that makes T0_DECIMATE_RATIO T0 samples span exactly
+ * MAINS_CYCLES mains periods, so the boxcar nulls line pickup and its harmonics */
+#define ADC_TRIGGER_PERIOD ((FCY*MAINS_CYCLES + MAINS_HZ*ADC_TRIGGERS_PER_SCAN*T0_DECIMATE_RATIO/2)/(MAINS_HZ*ADC_TRIGGERS_PER_SCAN*T0_DECIMATE_RATIO))
 
 
 /** @} */
 
+/** @defgroup TEMP_DEFS Temperature Conversion Definitions
+ * @{ */
+#define THERMISTOR_STEINHART 1 ///1 = compute thermistor temperatures (steinhart.c), 0 = use the generated lookup tables (temp_lookup.c)
+#define THERMISTOR_SCALE_MAX 26213 ///largest table temperature (1/80 C, about 327 C) whose scale-up to hundredths fits a 16 bit int
+#define T0_DECIMATE_RATIO 256 ///conversions per T0 reading (power of 2, 16-1024), the thermocouple picks up pump noise
+#define T1_DECIMATE_RATIO 64 ///conversions per T1 reading (power of 2, 16-1024)
+#define T2_DECIMATE_RATIO 64 ///conversions per T2 reading (power of 2, 16-1024)
+#define PROBE_MEDIAN_N 5 ///median window (in DMA blocks) ahead of the decimation filter: 0 (off), 3, 5 or 7
+#define T0_SLEW_MAX 2048 ///largest T0 block sum change per DMA block (about 15 C), 0 = no limit
+#define T1_SLEW_MAX 1024 ///largest T1 block sum change per DMA block, 0 = no limit
+#define T2_SLEW_MAX 1024 ///largest T2 block sum change per DMA block, 0 = no limit
+/** @} */
+
 /** @defgroup SWITCHES Switches
  * @{ */
 #define SW_SEL_DIR      TRISEbits.TRISE2
@@ -147,6 +211,32 @@
 #define K4_DIR      TRISEbits.TRISE5
 #define K5          LATEbits.LATE6
 #define K5_DIR      TRISEbits.TRISE6
+#define LCD_CATHODES_B  0x0007 ///K1..K3 bits in LATB
+#define LCD_CATHODES_E  0x0060 ///K4..K5 bits in LATE
+#define LCD_DIGITS      4 ///digits on the LTC-4727JR
+#define LCD_SLOTS       5 ///multiplex slots: 4 digits then the dots
+#define LCD_DOTS_SLOT   4 ///slot of the L1..L3 dots
+#define LCD_ALL_SLOTS   0xFF ///lcd_brightness() slot that means every slot
+#define LCD_DIM_STEPS   4 ///brightness steps per slot, the cathode is on for "brightness" of them (DMA: one Timer2 period each)
+#define LCD_STEPS       (LCD_SLOTS*LCD_DIM_STEPS) ///steps per display refresh (DMA: Timer2 periods)
+
+#define LCD_DAY_LEVEL   4 ///brightness (0 - LCD_DIM_STEPS) from LCD_DAY_HOUR
+#define LCD_NIGHT_LEVEL 1 ///brightness from LCD_NIGHT_HOUR, 0 = blank
+#define LCD_DAY_HOUR    7 ///RTC hour the display goes back to LCD_DAY_LEVEL
+#define LCD_NIGHT_HOUR  22 ///RTC hour the display dims to LCD_NIGHT_LEVEL
+
+#define LCD_TEXT_MAX        32 ///longest lcd_text() text (glyphs)
+#define LCD_SCROLL_TICKS    (TIMEBASE_TICKS_PER_SECOND/4) ///marquee step (250ms)
+
+#define LCD_REFRESH_ISR 0 ///_T2Interrupt() shows one slot per Timer2 period
+#define LCD_REFRESH_DMA 1 ///DMA5..7 show one slot per Timer2 period, no interrupt
+#define LCD_REFRESH     LCD_REFRESH_DMA ///selected display refresh
+
+#if LCD_REFRESH == LCD_REFRESH_DMA
+#define HEATER_SET(heaters, on) lcd_port_e((heaters), (on) ? (heaters) : 0) ///DMA6 rewrites LATE7..0, so the heaters go through its buffer (display.h)
+#else
+#define HEATER_SET(heaters, on) do { if(on) LATE |= (heaters); else LATE &= ~(heaters); } while(0) ///turns HEATER1 and/or HEATER2 on or off
+#endif
 
 #define AA1         LATDbits.LATD7
 #define AA1_DIR     TRISDbits.TRISD7
@@ -164,6 +254,7 @@
 #define AG_DIR      TRISDbits.TRISD1
 #define ADP         LATDbits.LATD0
 #define ADP_DIR     TRISDbits.TRISD0
+#define LCD_SEGMENTS (*(volatile unsigned char *)&LATD) ///LATD7..0 (AA1 AB2 AC3 AD AE AF AG ADP) as one byte, leaves LED3/LED4 alone
 
 /** @} */
 
@@ -203,6 +294,8 @@
 #define RTC_TEMP_MSB    0x11
 #define RTC_TEMP_LSB    0x12
 
+#define RTC_TEMP_PERIOD 64 ///seconds between board temperature reads (the DS3231 only converts every 64 s)
+
 /** @} */
 
 
@@ -6,6 +6,96 @@
 #include "defs.h"
 #include "globals.h"
 #include <libpic30.h> //for delays
+#include "timebase.h"
+#include "display.h"
+
+/* segment bits of an LCD_SEGMENTS byte (segments are active low) */
+#define LCD_SEG_A   0x80
+#define LCD_SEG_B   0x40
+#define LCD_SEG_C   0x20
+#define LCD_SEG_D   0x10
+#define LCD_SEG_E   0x08
+#define LCD_SEG_F   0x04
+#define LCD_SEG_G   0x02
+#define LCD_SEG_DP  0x01
+
+/* LCD_SEGMENTS byte for every character code, ready to write (active low,
+ * 0xFF = blank). Letters that have no 7-segment shape of their own share
+ * the nearest one (upper/lower case, K = H, M = n, ...). 0xB0 is the
+ * Latin-1 degree sign. */
+static const unsigned char lcd_glyphs[256] __attribute__((space(auto_psv))) = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x00 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x08 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x10 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x18 ........
+    0xFF, 0xFF, 0xBB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFB, //0x20  !"#$%&'
+    0x63, 0x0F, 0xFF, 0xFF, 0xFE, 0xFD, 0xFE, 0xB5, //0x28 ()*+,-./
+    0x03, 0x9F, 0x25, 0x0D, 0x99, 0x49, 0x41, 0x1F, //0x30 01234567
+    0x01, 0x09, 0xFF, 0xFF, 0xFF, 0xED, 0xFF, 0x35, //0x38 89:;<=>?
+    0xFF, 0x11, 0xC1, 0x63, 0x85, 0x61, 0x71, 0x43, //0x40 @ABCDEFG
+    0x91, 0xF3, 0x87, 0x91, 0xE3, 0x57, 0x13, 0x03, //0x48 HIJKLMNO
+    0x31, 0x19, 0xF5, 0x49, 0xE1, 0x83, 0x83, 0xAB, //0x50 PQRSTUVW
+    0x91, 0x89, 0x25, 0x63, 0xD9, 0x0F, 0x3B, 0xEF, //0x58 XYZ[.]^_
+    0xFF, 0x11, 0xC1, 0xE5, 0x85, 0x61, 0x71, 0x43, //0x60 `abcdefg
+    0xD1, 0xDF, 0x87, 0x91, 0xE3, 0x57, 0xD5, 0xC5, //0x68 hijklmno
+    0x31, 0x19, 0xF5, 0x49, 0xE1, 0xC7, 0x83, 0xAB, //0x70 pqrstuvw
+    0x91, 0x89, 0x25, 0xFF, 0xF3, 0xFF, 0xFF, 0xFF, //0x78 xyz{|}~.
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x80 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x88 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x90 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0x98 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xA0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xA8 ........
+    0x39, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xB0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xB8 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xC0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xC8 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xD0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xD8 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xE0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xE8 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //0xF0 ........
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF //0xF8 ........
+};
+
+/* cathode bits of each multiplex slot in LATB and LATE */
+static const unsigned char lcd_slot_cathodes_b[LCD_SLOTS] = {0x01, 0x02, 0x04, 0x00, 0x00}; //K1, K2, K3
+static const unsigned char lcd_slot_cathodes_e[LCD_SLOTS] = {0x00, 0x00, 0x00, 0x20, 0x40}; //K4, K5
+
+/* The refresh runs through LCD_STEPS steps, LCD_DIM_STEPS per slot. Every
+ * step of a slot shows the same segments; the cathode is only on for the
+ * first "brightness" steps, which sets the duty cycle of that digit. The
+ * ISR refresh only reads the first step of each slot and times the rest
+ * with PR2. */
+#if LCD_REFRESH == LCD_REFRESH_DMA
+/* DMA5..7 stream the steps straight from DMA RAM (see globals.c) */
+static unsigned char * const display_frames[2] = {&dma_lcd_frame_a[0], &dma_lcd_frame_b[0]};
+#define display_cathodes_b dma_lcd_cathodes_b
+#define display_cathodes_e dma_lcd_cathodes_e
+#else
+static unsigned char display_frame_a[LCD_STEPS];
+static unsigned char display_frame_b[LCD_STEPS];
+static unsigned char * const display_frames[2] = {&display_frame_a[0], &display_frame_b[0]};
+static unsigned char display_cathodes_b[LCD_STEPS]; ///LATB cathode bits of each step
+static unsigned char display_cathodes_e[LCD_STEPS]; ///LATE cathode bits of each step
+#endif
+
+/* Two framebuffers of LCD_SEGMENTS bytes, one per step: the display shows
+ * display_frames[display_front] while lcd_set() builds the other one */
+static volatile unsigned char display_front = 0; ///framebuffer being displayed
+static int display_value = 0; ///value from the last lcd_set()
+static char display_dots = 0; ///dots from the last lcd_set()
+static unsigned char display_valid = 0; ///1 once display_value/display_dots have been set
+static unsigned char display_level[LCD_SLOTS]; ///brightness of each slot (0 - LCD_DIM_STEPS)
+
+/* lcd_text() state: the text is kept as glyphs so scrolling never looks
+ * anything up again */
+static unsigned char display_text[LCD_TEXT_MAX + LCD_DIGITS]; ///glyphs of the text plus the blank gap/padding
+static unsigned char display_text_length = 0; ///glyphs in display_text
+static unsigned char display_text_pos = 0; ///first glyph on the display
+static unsigned char display_text_passes = 0; ///trips left before the value comes back (0 = forever)
+static unsigned char display_text_active = 0; ///1 while text is shown instead of the value
+static unsigned long display_scroll_time = 0; ///timebase_read() of the last marquee step
 
 
 /*! \brief Initializes LCD Display
@@ -13,6 +103,8 @@
  */
 
 unsigned char lcd_init() {
+    unsigned char inc;
+
       //LCD PINS
     //turn off all characters/segments:
     K1 = 0; //K pins are active high
@@ -46,22 +138,142 @@ unsigned char lcd_init() {
     PMD2bits.OC8MD = 0;
     CNPU2bits.CN16PUE = 0; //turn off pullup
 
+    for(inc = 0; inc < LCD_STEPS; inc++) {
+        display_frames[0][inc] = 0xFF;
+        display_frames[1][inc] = 0xFF;
+    }
+    lcd_brightness(LCD_ALL_SLOTS, LCD_DAY_LEVEL);
+
+#if LCD_REFRESH == LCD_REFRESH_DMA
+    /* Every Timer2 period DMA5 writes the next step's cathodes to LATB,
+     * DMA6 to LATE and DMA7 the step's segments to LATD (in that order, by
+     * channel priority). Byte transfers only touch the low half of each
+     * port. The three channels share the trigger and the block length, so
+     * they always stay on the same step. */
+    DMA5CONbits.SIZE = 1; //byte
+    DMA5CONbits.DIR = 1; //RAM -> LATB
+    DMA5CONbits.HALF = 0;
+    DMA5CONbits.NULLW = 0;
+    DMA5CONbits.AMODE = 0; //register indirect with post-increment
+    DMA5CONbits.MODE = 0; //continuous, no ping pong
+    DMA5REQbits.IRQSEL = 7; //Timer2
+    DMA5PAD = (int)&LATB;
+    DMA5CNT = LCD_STEPS - 1;
+    DMA5STA = __builtin_dmaoffset(dma_lcd_cathodes_b);
+
+    DMA6CONbits.SIZE = 1; //byte
+    DMA6CONbits.DIR = 1; //RAM -> LATE
+    DMA6CONbits.HALF = 0;
+    DMA6CONbits.NULLW = 0;
+    DMA6CONbits.AMODE = 0; //register indirect with post-increment
+    DMA6CONbits.MODE = 0; //continuous, no ping pong
+    DMA6REQbits.IRQSEL = 7; //Timer2
+    DMA6PAD = (int)&LATE;
+    DMA6CNT = LCD_STEPS - 1;
+    DMA6STA = __builtin_dmaoffset(dma_lcd_cathodes_e);
+
+    DMA7CONbits.SIZE = 1; //byte
+    DMA7CONbits.DIR = 1; //RAM -> LATD
+    DMA7CONbits.HALF = 0;
+    DMA7CONbits.NULLW = 0;
+    DMA7CONbits.AMODE = 0; //register indirect with post-increment
+    DMA7CONbits.MODE = 0; //continuous, no ping pong
+    DMA7REQbits.IRQSEL = 7; //Timer2
+    DMA7PAD = (int)&LATD;
+    DMA7CNT = LCD_STEPS - 1;
+    DMA7STA = __builtin_dmaoffset(dma_lcd_frame_a);
+
+    DMA5CONbits.CHEN = 1;
+    DMA6CONbits.CHEN = 1;
+    DMA7CONbits.CHEN = 1;
+#endif
+
     return 0;
 }
 
-/*! \brief Displays value on the LCD screen
+/*! \brief Makes a set of slot glyphs the displayed frame
+ *
+ *  Writes the glyphs into every step of the back framebuffer and swaps the
+ *  buffers with a single byte write, so the refresh (lcd_refresh() in the
+ *  Timer2 ISR, or DMA7) only ever copies ready-made port values.
+ */
+
+static void lcd_show(unsigned char *glyph) {
+    unsigned char back = display_front ^ 1;
+    unsigned char *segments = display_frames[back];
+    unsigned char step;
+
+    for(step = 0; step < LCD_STEPS; step++) {
+        segments[step] = glyph[step / LCD_DIM_STEPS];
+    }
+
+    display_front = back; //swap
+#if LCD_REFRESH == LCD_REFRESH_DMA
+    //DMA7 picks the new frame up at its next block (step 0)
+    if(back) {
+        DMA7STA = __builtin_dmaoffset(dma_lcd_frame_b);
+    } else {
+        DMA7STA = __builtin_dmaoffset(dma_lcd_frame_a);
+    }
+#endif
+}
+
+/*! \brief Encodes value and dots and shows them
+ */
+
+static void lcd_show_value(int value, char dots) {
+    int digit_val[LCD_DIGITS];
+    unsigned char glyph[LCD_SLOTS];
+    unsigned char pattern;
+    unsigned char inc;
+
+    digit_val[0] = (value/1000)%10;
+    digit_val[1] = (value/100)%10;
+    digit_val[2] = (value/10)%10;
+    digit_val[3] = value%10;
+
+    for(inc = 0; inc < LCD_DIGITS; inc++) {
+        glyph[inc] = lcd_glyphs[' '];
+        if(digit_val[inc] >= 0 && digit_val[inc] <= 9) {
+            glyph[inc] = lcd_glyphs['0' + digit_val[inc]];
+        }
+        if(((dots >> (3 + inc)) & 0b01) == 1) {
+            glyph[inc] &= ~LCD_SEG_DP;
+        }
+    }
+
+    //L1..L3 are wired to the A, B and C segments of the dots slot
+    pattern = 0;
+    if( (dots&0b01) == 1) {
+        pattern |= LCD_SEG_A;
+    }
+    if( ((dots>>1) & 0b01) == 1) {
+        pattern |= LCD_SEG_B;
+    }
+    if( ((dots>>2) & 0b01) == 1) {
+        pattern |= LCD_SEG_C;
+    }
+    glyph[LCD_DOTS_SLOT] = ~pattern;
+
+    lcd_show(&glyph[0]);
+}
+
+/*! \brief Displays value and dots
  *
  *  This function dislays a value on the LTC-4727JR Display.
  *  A value of more than 4 digits (ie: 12345) will be concatenated
  *  to the four least-significant digits (2345).
  *
- *  digit is a char between 0 and 4 -- it specifies which digit to be display
- *  (the 4 digits and then dots are multiplexed. 
- *  0 = (K1) (most significant digit)
- *  1 = (K2)
- *  2 = (K4)
- *  3 = (K5) (least significant digit)
- *  4 = dots (K3)
+ *  The divides and the segment encoding are done here, in the main loop,
+ *  and only when value or dots change. While lcd_text() is showing text the
+ *  new value is only remembered and comes back when the text is done.
+ *
+ *  The 4 digits and then the dots are multiplexed:
+ *  slot 0 = (K1) (most significant digit)
+ *  slot 1 = (K2)
+ *  slot 2 = (K3)
+ *  slot 3 = (K4) (least significant digit)
+ *  slot 4 = dots (K5)
  *
  *  dots specifies which dots to light up:
  *  dots{6-0}
@@ -85,160 +297,275 @@ unsigned char lcd_init() {
  * 
  */
 
-unsigned char lcd_display(char digit, int value, char dots) {
-    unsigned char segment_val = 0;
+unsigned char lcd_set(int value, char dots) {
+    if(display_valid && value == display_value && dots == display_dots) {
+        return 1; /*! \return 1 = nothing changed, frame not rebuilt */
+    }
 
+    display_value = value;
+    display_dots = dots;
+    display_valid = 1;
 
-    //turn off all characters
-    K1 = 0;
-    K2 = 0;
-    K3 = 0;
-    K4 = 0;
-    K5 = 0;
+    if(display_text_active) {
+        return 1; //shown when the text is done
+    }
+
+    lcd_show_value(value, dots);
+
+    return 0; /*! \return 0 = new frame displayed */
+}
 
+/*! \brief Shows the current marquee window of the text
+ */
 
-    //extract the character info for to assign the segments
+static void lcd_show_text(void) {
+    unsigned char glyph[LCD_SLOTS];
+    unsigned char pos = display_text_pos;
+    unsigned char inc;
 
-    if(digit == 0) {   //K1, most significant digit
-        segment_val = (value/1000)%10;
-    } else if(digit == 1) { //K2
-        segment_val = (value/100)%10;
-    } else if(digit == 2) { //K4
-        segment_val = (value/10)%10;
-    } else if(digit == 3) { //K5
-        segment_val = (value%10);
-    } else { //dots
-        segment_val = 10;
+    for(inc = 0; inc < LCD_DIGITS; inc++) {
+        glyph[inc] = display_text[pos];
+        if(++pos >= display_text_length) {
+            pos = 0;
+        }
     }
+    glyph[LCD_DOTS_SLOT] = 0xFF;
 
-    //turn off all segments
-    AA1 = 1;
-    AB2 = 1;
-    AC3 = 1;
-    AD = 1;
-    AE = 1;
-    AF = 1;
-    AG = 1;
-    ADP = 1;
+    lcd_show(&glyph[0]);
+}
+
+/*! \brief Displays text, scrolling it if it is longer than the display
+ *
+ *  text is length characters (it does not need to be NUL terminated, e.g.
+ *  timeData.timestring). Each character is looked up in the glyph table
+ *  once, here; a '.' or ',' lights the decimal point of the character
+ *  before it instead of taking a digit of its own.
+ *
+ *  Text of up to LCD_DIGITS glyphs is shown as is. Longer text scrolls one
+ *  glyph every LCD_SCROLL_TICKS with a blank gap between repeats, driven by
+ *  lcd_task(). Every step is rendered into the framebuffer from the main
+ *  loop, so scrolling costs nothing in the refresh.
+ *
+ *  The text stays up for passes trips through it (a short text counts one
+ *  trip every LCD_DIGITS steps), then the lcd_set() value comes back.
+ *  passes = 0 keeps it up until lcd_text_stop().
+ */
 
+unsigned char lcd_text(const unsigned char *text, unsigned char length, unsigned char passes) {
+    unsigned char glyphs = 0;
+    unsigned char inc;
 
-    switch(segment_val) {
-        case(0):
-            AA1 = 0;
-            AB2 = 0;
-            AC3 = 0;
-            AD = 0;
-            AE = 0;
-            AF = 0;
-            break;
-        case(1):
-            AB2 = 0;
-            AC3 = 0;
-            break;
-        case(2):
-            AA1 = 0;
-            AB2 = 0;
-            AG = 0;
-            AE = 0;
-            AD = 0;
-            break;
-        case(3):
-            AA1 = 0;
-            AB2 = 0;
-            AG = 0;
-            AC3 = 0;
-            AD = 0;
-            break;
-        case(4):
-            AF = 0;
-            AG = 0;
-            AB2 = 0;
-            AC3 = 0;
-            break;
-        case(5):
-            AA1 = 0;
-            AF = 0;
-            AG = 0;
-            AC3 = 0;
-            AD = 0;
-            break;
-        case(6):
-            AA1 = 0;
-            AF = 0;
-            AG = 0;
-            AC3 = 0;
-            AD = 0;
-            AE = 0;
-            break;
-        case(7):
-            AA1 = 0;
-            AB2 = 0;
-            AC3 = 0;
-            break;
-        case(8):
-            AA1 = 0;
-            AB2 = 0;
-            AC3 = 0;
-            AD = 0;
-            AE = 0;
-            AF = 0;
-            AG = 0;
-            break;
-        case(9):
-            AA1 = 0;
-            AB2 = 0;
-            AC3 = 0;
-            AD = 0;
-            AF = 0;
-            AG = 0;
-            break;
-        case(10):
-            if( (dots&0b01) == 1) {
-                AA1 = 0;
-            }
-            if( ((dots>>1) & 0b01) == 1) {
-                AB2 = 0;
-            }
-            if( ((dots>>2) & 0b01) == 1) {
-                AC3 = 0;
-            }
-            break;
+    for(inc = 0; inc < length; inc++) {
+        if((text[inc] == '.' || text[inc] == ',') && glyphs > 0 && (display_text[glyphs-1] & LCD_SEG_DP)) {
+            display_text[glyphs-1] &= ~LCD_SEG_DP; //join the previous character
+        } else if(glyphs < LCD_TEXT_MAX) {
+            display_text[glyphs++] = lcd_glyphs[text[inc]];
+        }
     }
 
-    
+    //blank padding for short text, blank gap between repeats for long text
+    inc = (glyphs > LCD_DIGITS) ? LCD_DIGITS : LCD_DIGITS - glyphs;
+    while(inc--) {
+        display_text[glyphs++] = lcd_glyphs[' '];
+    }
 
-    //add the dp's, then turn on the individual display
+    display_text_length = glyphs;
+    display_text_pos = 0;
+    display_text_passes = passes;
+    display_text_active = 1;
+    display_scroll_time = timebase_read();
 
-    if(digit == 0) {   //K1, most significant digit
-        if( ((dots>>3) & 0b01) == 1) {
-            ADP = 0;
-        }
-        K1 = 1;
-    } else if(digit == 1) { //K2
-        if( ((dots>>4) & 0b01) == 1) {
-            ADP = 0;
-        }
-        K2 = 1;
-    } else if(digit == 2) { //K4
-        if( ((dots>>5) & 0b01) == 1) {
-            ADP = 0;
-        }
-        K3 = 1;
-    } else if(digit == 3) { //K5
-        if( ((dots>>6) & 0b01) == 1) {
-            ADP = 0;
+    lcd_show_text();
+
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Takes the text down and shows the lcd_set() value again
+ */
+
+void lcd_text_stop(void) {
+    if(display_text_active) {
+        display_text_active = 0;
+        lcd_show_value(display_value, display_dots);
+    }
+}
+
+/*! \brief Advances the text marquee (call from the main loop)
+ */
+
+unsigned char lcd_task(void) {
+    if(!display_text_active || timebase_read() - display_scroll_time < LCD_SCROLL_TICKS) {
+        return 1; /*! \return 1 = nothing to do */
+    }
+    display_scroll_time += LCD_SCROLL_TICKS;
+
+    if(++display_text_pos >= display_text_length) {
+        display_text_pos = 0;
+        if(display_text_passes != 0 && --display_text_passes == 0) {
+            lcd_text_stop();
+            return 0;
         }
-        K4 = 1;
-    } else { //dots (K3)
-        K5 = 1;
     }
 
+    if(display_text_length > LCD_DIGITS) {
+        lcd_show_text();
+    }
+
+    return 0; /*! \return 0 = display updated */
+}
+
+/*! \brief Sets the brightness of one slot, or of all of them
+ *
+ *  level is the number of the slot's LCD_DIM_STEPS steps its cathode is on
+ *  for (0 = blank, LCD_DIM_STEPS = full brightness). slot is 0-4 (see
+ *  lcd_set()) or LCD_ALL_SLOTS. Only the cathode step tables change, so the
+ *  DMA refresh does no extra work at any brightness.
+ *
+ *  In LCD_REFRESH_ISR mode a dimmed slot takes one extra Timer2 interrupt
+ *  to end its on time (see lcd_refresh()). Timer2 is stopped while every
+ *  slot is blank, so a blanked display costs no interrupts at all.
+ */
+
+unsigned char lcd_brightness(unsigned char slot, unsigned char level) {
+    unsigned char first = slot;
+    unsigned char last = slot;
+    unsigned char inc;
+    unsigned char step;
+#if LCD_REFRESH == LCD_REFRESH_ISR
+    static unsigned char blanked = 0;
+    unsigned char lit = 0;
+#endif
 
-    
-    Nop();
-    Nop();
+    if(level > LCD_DIM_STEPS) {
+        level = LCD_DIM_STEPS;
+    }
+    if(slot == LCD_ALL_SLOTS) {
+        first = 0;
+        last = LCD_SLOTS - 1;
+    } else if(slot >= LCD_SLOTS) {
+        return 1; /*! \return 1 = no such slot */
+    }
 
+    for(inc = first; inc <= last; inc++) {
+        display_level[inc] = level;
+        for(step = 0; step < LCD_DIM_STEPS; step++) {
+            if(step < level) {
+                display_cathodes_b[inc*LCD_DIM_STEPS + step] = lcd_slot_cathodes_b[inc];
+                display_cathodes_e[inc*LCD_DIM_STEPS + step] = (display_cathodes_e[inc*LCD_DIM_STEPS + step] & ~LCD_CATHODES_E) | lcd_slot_cathodes_e[inc];
+            } else {
+                display_cathodes_b[inc*LCD_DIM_STEPS + step] = 0;
+                display_cathodes_e[inc*LCD_DIM_STEPS + step] &= ~LCD_CATHODES_E;
+            }
+        }
+    }
 
+#if LCD_REFRESH == LCD_REFRESH_ISR
+    for(inc = 0; inc < LCD_SLOTS; inc++) {
+        lit |= display_level[inc];
+    }
+    if(!lit) {
+        TIMER2_ON = 0;
+        LATB &= ~LCD_CATHODES_B;
+        LATE &= ~LCD_CATHODES_E;
+        blanked = 1;
+    } else if(blanked) {
+        TIMER2_ON = 1;
+        blanked = 0;
+    }
+#endif
 
     return 0; /*! \return 0 = success */
-}
\ No newline at end of file
+}
+
+/*! \brief Dims or blanks the display at night (call with the RTC hour)
+ *
+ *  Uses LCD_NIGHT_LEVEL from LCD_NIGHT_HOUR until LCD_DAY_HOUR and
+ *  LCD_DAY_LEVEL the rest of the day. The brightness is only rewritten when
+ *  the schedule changes, so it is cheap to call every second.
+ */
+
+unsigned char lcd_schedule(unsigned char hours) {
+    static unsigned char night = 0xFF;
+    unsigned char now = 0;
+
+    if(LCD_NIGHT_HOUR > LCD_DAY_HOUR) {
+        now = (hours >= LCD_NIGHT_HOUR || hours < LCD_DAY_HOUR);
+    } else {
+        now = (hours >= LCD_NIGHT_HOUR && hours < LCD_DAY_HOUR);
+    }
+
+    if(now == night) {
+        return 1; /*! \return 1 = no change */
+    }
+    night = now;
+
+    lcd_brightness(LCD_ALL_SLOTS, night ? LCD_NIGHT_LEVEL : LCD_DAY_LEVEL);
+
+    return 0; /*! \return 0 = brightness changed */
+}
+
+#if LCD_REFRESH == LCD_REFRESH_DMA
+/*! \brief Sets LATE7..0 outputs that are not display cathodes
+ *
+ *  DMA6 rewrites the low byte of LATE on every refresh, so other outputs
+ *  there (HEATER1, HEATER2) must be set through the DMA buffer instead of
+ *  LATE. bits selected by mask are copied into every step.
+ */
+
+void lcd_port_e(unsigned char mask, unsigned char bits) {
+    unsigned char inc;
+
+    mask &= ~LCD_CATHODES_E;
+    for(inc = 0; inc < LCD_STEPS; inc++) {
+        dma_lcd_cathodes_e[inc] = (dma_lcd_cathodes_e[inc] & ~mask) | (bits & mask);
+    }
+}
+
+#else
+/*! \brief Shows the next multiplex slot (call from the Timer2 ISR)
+ *
+ *  Every cathode is switched off before the segments change and the new
+ *  cathode only comes on after, so the previous digit never sees the next
+ *  digit's segments (no ghosting). Each step is a single masked
+ *  read-modify-write instruction on its port: AND for the cathodes off,
+ *  a byte store for all eight segments, IOR for the cathode on. Other pins
+ *  on those ports (LEDs, heaters) are not touched.
+ *
+ *  Timer2 interrupts once per slot, not once per dimming step. A dimmed
+ *  slot reloads PR2 with its on time and takes one more interrupt to turn
+ *  the cathode off for the rest of the slot period, so a slot costs at most
+ *  two interrupts at any brightness.
+ */
+
+void lcd_refresh(void) {
+    static unsigned char slot = LCD_SLOTS - 1;
+    static unsigned char lit = 0; //1 = a dimmed slot is on and its off time is next
+    unsigned char level;
+
+    //turn off all characters
+    LATB &= ~LCD_CATHODES_B;
+    LATE &= ~LCD_CATHODES_E;
+
+    if(lit) {
+        PR2 = TIMER2_PERIOD - PR2; //dark for the rest of the slot
+        lit = 0;
+        return;
+    }
+
+    if(++slot >= LCD_SLOTS) {
+        slot = 0;
+    }
+    LCD_SEGMENTS = display_frames[display_front][slot*LCD_DIM_STEPS];
+
+    LATB |= display_cathodes_b[slot*LCD_DIM_STEPS];
+    LATE |= display_cathodes_e[slot*LCD_DIM_STEPS];
+
+    level = display_level[slot];
+    if(level > 0 && level < LCD_DIM_STEPS) {
+        PR2 = level*(TIMER2_PERIOD/LCD_DIM_STEPS);
+        lit = 1;
+    } else {
+        PR2 = TIMER2_PERIOD;
+    }
+}
+#endif
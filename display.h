@@ -2,7 +2,16 @@
 #ifndef INC_DISPLAY_H
 #define INC_DISPLAY_H
 
-unsigned char lcd_display(int value, char display, char dots);
+unsigned char lcd_set(int value, char dots);
+unsigned char lcd_text(const unsigned char *text, unsigned char length, unsigned char passes);
+void lcd_text_stop(void);
+unsigned char lcd_task(void);
+unsigned char lcd_brightness(unsigned char slot, unsigned char level);
+unsigned char lcd_schedule(unsigned char hours);
+#if LCD_REFRESH == LCD_REFRESH_DMA
+void lcd_port_e(unsigned char mask, unsigned char bits);
+#else
+void lcd_refresh(void);
+#endif
 unsigned char lcd_init();
 #endif
-
@@ -3,7 +3,25 @@
     
     
 */
-unsigned int dma_adc_buf[16] __attribute__((space(dma))); //space in DMA memory to hold the ADC results
+#include "defs.h"
+
+/* The ADC supplies the low address bits in peripheral indirect mode, so the
+ * buffers must be aligned to a power of two at least as large as themselves */
+unsigned int dma_adc_buf_a[ADC_DMA_BUF_LENGTH] __attribute__((space(dma),aligned(256))); //ADC DMA ping buffer
+unsigned int dma_adc_buf_b[ADC_DMA_BUF_LENGTH] __attribute__((space(dma),aligned(256))); //ADC DMA pong buffer
+
+/* One SD write as it goes out on SPI1: DMA2 sends it while DMA0 drains the
+ * bytes the card clocks back into dma_sd_discard (see SD_WriteMultiBlockDMA()) */
+unsigned char dma_sd_block[SD_DMA_LENGTH] __attribute__((space(dma))); //SD data token, block and CRC
+unsigned char dma_sd_discard __attribute__((space(dma))); //SPI1 receive sink while a block streams out
+
+#if LCD_REFRESH == LCD_REFRESH_DMA
+/* Display steps streamed to the ports by DMA5..7 (filled by lcd_init()) */
+unsigned char dma_lcd_frame_a[LCD_STEPS] __attribute__((space(dma))); //LATD7..0 framebuffer
+unsigned char dma_lcd_frame_b[LCD_STEPS] __attribute__((space(dma))); //LATD7..0 framebuffer
+unsigned char dma_lcd_cathodes_b[LCD_STEPS] __attribute__((space(dma))); //LATB7..0: K1, K2, K3
+unsigned char dma_lcd_cathodes_e[LCD_STEPS] __attribute__((space(dma))); //LATE7..0: K4, K5 (+ lcd_port_e())
+#endif
 
 /*SETUP GLOBAL VARIABLES*/
 
@@ -3,7 +3,17 @@
  
 /*SETUP GLOBAL VARIABLES*/
 
-extern unsigned int dma_adc_buf[16] __attribute__((space(dma))); //space in DMA memory to hold the ADC results
+extern unsigned int dma_adc_buf_a[ADC_DMA_BUF_LENGTH] __attribute__((space(dma),aligned(256))); //ADC DMA ping buffer
+extern unsigned int dma_adc_buf_b[ADC_DMA_BUF_LENGTH] __attribute__((space(dma),aligned(256))); //ADC DMA pong buffer
+extern unsigned char dma_sd_block[SD_DMA_LENGTH] __attribute__((space(dma))); //SD data token, block and CRC
+extern unsigned char dma_sd_discard __attribute__((space(dma))); //SPI1 receive sink while a block streams out
+
+#if LCD_REFRESH == LCD_REFRESH_DMA
+extern unsigned char dma_lcd_frame_a[LCD_STEPS] __attribute__((space(dma))); //LATD7..0 framebuffer
+extern unsigned char dma_lcd_frame_b[LCD_STEPS] __attribute__((space(dma))); //LATD7..0 framebuffer
+extern unsigned char dma_lcd_cathodes_b[LCD_STEPS] __attribute__((space(dma))); //LATB7..0: K1, K2, K3
+extern unsigned char dma_lcd_cathodes_e[LCD_STEPS] __attribute__((space(dma))); //LATE7..0: K4, K5
+#endif
 
 
 
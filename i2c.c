@@ -104,6 +104,75 @@ unsigned char i2c_read_byte(unsigned char slave_address, unsigned char slave_reg
 }
 
 
+/*! \brief Reads consecutive registers in one transaction
+ *
+ *  Same sequence as i2c_read_byte() but keeps clocking bytes out of the
+ *  slave (which auto-increments its register pointer), ACKing all but the
+ *  last one. One start/address overhead for the whole block instead of one
+ *  per register.
+ */
+
+unsigned char i2c_read_burst(unsigned char slave_address, unsigned char slave_register, unsigned char *pData, unsigned char length) {
+    unsigned char inc;
+
+    /*begin start condition */
+    IdleI2C2(); //wait for bus to be idle
+    IFS3bits.MI2C2IF = 0; //clear interrupt flag
+    I2C2CONbits.SEN = 1; //set start event
+    while(I2C2CONbits.SEN); //wait for the startup sequence to complete
+
+    /*send device address (r/w cleared) */
+    I2C2TRN = slave_address & 0xFD;
+    IFS3bits.MI2C2IF = 0;
+    while(I2C2STATbits.TBF); //wait for data to clock out
+    while(I2C2STATbits.ACKSTAT); //wait for device to acknowledge
+    IdleI2C2();
+
+    /*send first slave register address*/
+    I2C2TRN = slave_register;
+    IFS3bits.MI2C2IF = 0;
+    while(I2C2STATbits.TBF); //wait for data to clock out
+    while(I2C2STATbits.ACKSTAT); //wait for device to acknowledge
+    IdleI2C2();
+
+    /*initiate a repeated start*/
+    while(I2C2CON & 0x001F); //wait for the module to be ready (see 19.5.6 of dsPIC33 reference manual 12C)
+    I2C2CONbits.RSEN = 1;
+    while(I2C2CONbits.RSEN); //wait for slave to respond
+
+    /*send device address (read/write set) */
+    I2C2TRN = slave_address | 0x1;
+    IFS3bits.MI2C2IF = 0;
+    while(I2C2STATbits.TBF); //wait for data to clock out
+    while(I2C2STATbits.ACKSTAT); //wait for device to acknowledge
+    IdleI2C2();
+
+    /*receive data from device*/
+    for(inc = 0; inc < length; inc++) {
+        I2C2CONbits.RCEN = 1; //receive enable (start clocking for slave transfer)
+        while(I2C2CONbits.RCEN); //wait for data
+        pData[inc] = I2C2RCV;
+        IdleI2C2();
+
+        if(inc == length - 1) {
+            NotAckI2C2(); //last byte
+        } else {
+            AckI2C2(); //more to come
+        }
+        while(I2C2CONbits.ACKEN);
+    }
+
+    /*generate stop bus event*/
+    IFS3bits.MI2C2IF = 0;
+    while(I2C2CON & 0x001F); //wait for the module to be ready (see 19.5.5 of dsPIC33 reference manual 12C)
+    I2C2CONbits.PEN = 1;
+    while(IFS3bits.MI2C2IF == 0);
+
+    /*done!*/
+    return 0;
+}
+
+
 unsigned char i2c_write_byte (unsigned char slave_address, unsigned char slave_register, unsigned char data_out) {
     
 
@@ -3,6 +3,7 @@
 
 unsigned char i2c_init();
 unsigned char i2c_read_byte(unsigned char slave_address, unsigned char slave_register);
+unsigned char i2c_read_burst(unsigned char slave_address, unsigned char slave_register, unsigned char *pData, unsigned char length);
 unsigned char i2c_write_byte(unsigned char slave_address, unsigned char slave_register, unsigned char data_out);
 
 
@@ -9,6 +9,7 @@
 #include <p33FJ256GP510A.h>
 #include "defs.h"
 #include "globals.h"
+#include "display.h"
 #include <i2c.h>
 
 unsigned char adc_init() {
@@ -19,22 +20,55 @@ unsigned char adc_init() {
     DMA1_FLAG = 0;
     DMA1_IE = 1; //enable ADC DMA interrupt
 
-    AD1CSSL = 0b0000000000111000;
-    AD1CON1bits.AD12B = 1; //12 bit operation
+#if ADC_TRIGGER == ADC_TRIGGER_MAINS
+#if ADC_TRIGGER_PERIOD < ADC_CONVERT_CYCLES || ADC_TRIGGER_PERIOD > 65536
+#error "MAINS_CYCLES and T0_DECIMATE_RATIO give a Timer3 period the ADC cannot use"
+#endif
+    //Timer3 paces the conversions (see ADC_TRIGGER_PERIOD)
+    T3CONbits.TON = 0;
+    T3CONbits.TCS = 0; //internal clock (FCY)
+    T3CONbits.TGATE = 0; //gated time accumulation disabled
+    T3CONbits.TCKPS = 0b00; //1:1 prescaler
+    TMR3 = 0;
+    PR3 = ADC_TRIGGER_PERIOD - 1;
+    AD1CON1bits.SSRC = 0b010; //Timer3 compare ends sampling and starts conversion
+#else
     AD1CON1bits.SSRC = 0b111; //auto-sample period
+#endif
     AD1CON2bits.VCFG = 0b001; //Vref+, VSS
     AD1CON3bits.ADRC = 0; //derive ADC clock from internal clock
     AD1CON1bits.FORM = 00; //store results as unsigned integer
-    AD1CON2bits.CHPS = 00; //only sample channel 0;
     AD1CON3bits.ADCS = 0x3F; //T_AD = TCY * 64   (CHECK THIS LATER, T_AD should be > 117.6ns)
     AD1CON3bits.SAMC = 14; //14 TAD in a conversion
     AD1CON4bits.DMABL = 0b100; //16 words of buffer for each input
     AD1CON2bits.ALTS = 0; //always sample on MUXA
     AD1CON1bits.ASAM = 1; //autosample
-    AD1CON1bits.ADDMABM = 1; //write buffer sequentially
-    AD1CON2bits.SMPI = 0xF; //interrupt every sixteen conversions
     AD1CON2bits.BUFM = 0; //always start at beginning of buffer
-    ADC_SOURCE = T2_AN; //select T2
+
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+    /* The 256GP510A has a single ADC, but in 10-bit mode it has four
+     * sample/hold amplifiers. With CH123SA = 1 they are wired to AN3 (CH1),
+     * AN4 (CH2) and AN5 (CH3), so the thermocouple and both thermistors are
+     * captured at the same instant and then converted back to back. CH0 also
+     * samples the thermocouple to give the noisiest input twice the samples. */
+    AD1CON1bits.AD12B = 0; //10 bit operation (required for CH1..CH3)
+    AD1CON2bits.CHPS = 0b10; //convert CH0, CH1, CH2 and CH3
+    AD1CON1bits.SIMSAM = 1; //sample all channels simultaneously
+    AD1CON2bits.CSCNA = 0; //no scanning
+    AD1CHS0bits.CH0SA = T0_AN; //CH0 = thermocouple
+    AD1CHS0bits.CH0NA = 0; //CH0- = Vref-
+    AD1CHS123bits.CH123SA = 1; //CH1 = AN3 (T0), CH2 = AN4 (T1), CH3 = AN5 (T2)
+    AD1CHS123bits.CH123NA = 0; //CH1..CH3- = Vref-
+    AD1CON1bits.ADDMABM = 1; //write results in conversion order
+    AD1CON2bits.SMPI = ADC_SIMSAM_CHANNELS - 1; //one DMA request per channel in each sequence
+#else
+    AD1CSSL = 0b0000000000111000; //scan T0_AN, T1_AN and T2_AN
+    AD1CON1bits.AD12B = 1; //12 bit operation
+    AD1CON2bits.CHPS = 00; //only sample channel 0;
+    AD1CON2bits.CSCNA = 1; //scan the CH0 inputs selected in AD1CSSL
+    AD1CON1bits.ADDMABM = 0; //scatter/gather: each input gets its own DMABL sized slot
+    AD1CON2bits.SMPI = ADC_NUM_CHANNELS - 1; //advance the DMA slot index after every complete scan
+#endif
 
     //DMA Setup
 
@@ -43,15 +77,23 @@ unsigned char adc_init() {
     DMA1CONbits.DIR = 0; //ADC -> RAM
     DMA1CONbits.HALF = 0; //initiate interrupt when buffer is full
     DMA1CONbits.NULLW = 0; //dont send null transfer back to peripheral
-    DMA1CONbits.MODE = 0; //continuoius, ping pong disabled
-    DMA1CONbits.AMODE = 0; //check this
-    DMA1STA = __builtin_dmaoffset(&dma_adc_buf); //point to the buffer
+    DMA1CONbits.MODE = 0b10; //continuous, ping pong enabled
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+    DMA1CONbits.AMODE = 0; //register indirect with post-increment
+#else
+    DMA1CONbits.AMODE = 0b10; //peripheral indirect addressing (ADC supplies the offset)
+#endif
+    DMA1STA = __builtin_dmaoffset(dma_adc_buf_a); //ping buffer
+    DMA1STB = __builtin_dmaoffset(dma_adc_buf_b); //pong buffer
     DMA1REQbits.IRQSEL = 13; //IRQ of ADC1
     DMA1PAD = (int)&ADC1BUF0;
-    DMA1CNT = 31;
+    DMA1CNT = ADC_DMA_TRANSFERS - 1; //interrupt (and swap buffers) after a full block of every input
 
     AD1CON1bits.ADON = 1; //turn on the ADC module
     DMA1CONbits.CHEN = 1;
+#if ADC_TRIGGER == ADC_TRIGGER_MAINS
+    T3CONbits.TON = 1; //start triggering conversions
+#endif
 
     return 0;
 }
@@ -63,11 +105,19 @@ unsigned char timer2_init() {
     T2CONbits.TCKPS = 0b11; //1:256 prescaler
     T2CONbits.TCS = 0; //use external clock (FOSC/2)
     T2CONbits.TGATE = 0; //gated time accumulation disabled
-    PR2 = TIMER2_PERIOD; //800 instructions => 195Hz sample rate
+#if LCD_REFRESH == LCD_REFRESH_DMA
+    PR2 = TIMER2_PERIOD/LCD_DIM_STEPS; //one brightness step, LCD_DIM_STEPS DMA transfers per digit
+#else
+    PR2 = TIMER2_PERIOD; //one digit, lcd_refresh() shortens it while a dimmed digit is on
+#endif
 
     TMR2_FLAG = 0; //clear timer2 interrupt flag
     IPC1bits.T2IP = 4; //timer 2 interrupt priority 4
+#if LCD_REFRESH == LCD_REFRESH_DMA
+    TMR2_IE = 0; //Timer2 only triggers the display DMA channels
+#else
     TMR2_IE = 1; //enable timer2 interrupt
+#endif
 
 
     return 0;
@@ -130,8 +180,7 @@ void init(void) {
     
 
     //HEATER SETUP
-    HEATER1 = 0;
-    HEATER2 = 0;
+    HEATER_SET(HEATER1 | HEATER2, 0);
     HEATER1_DIR = 0; //output
     HEATER2_DIR = 0; //output
 
@@ -0,0 +1,401 @@
+/*! \file log_codec.c
+    \brief Packing of logged temperature samples into record block payloads
+
+    Every payload starts from scratch with one whole sample, so any block
+    decodes without the ones before it. Two formats are built, selected by
+    LOG_CODEC in defs.h.
+
+    LOG_CODEC_VARINT: the first sample is a 4 byte timestamp and a 2 byte
+    temperature per channel, all little endian. Each later sample is a
+    varint of the timestamp delta and then, per channel, a varint of the
+    zigzag-coded temperature delta. A varint holds 7 bits per byte, low bits
+    first, and the top bit set means more bytes follow. Zigzag maps 0, -1,
+    1, -2, ... to 0, 1, 2, 3, ... so small steps either way fit one byte.
+    A sample costs 5.05 bytes instead of the 10 of a raw logSample on the
+    simulated brewing week of tools/test_log_codec.c, and 5.05 to 10.67 on
+    its random walks.
+
+    LOG_CODEC_GORILLA: a bitstream, most significant bit first, after a 2
+    byte little endian sample count. The first sample is a 32 bit timestamp
+    and a 16 bit temperature per channel. Each later sample stores the
+    zigzag delta-of-delta of the timestamp and then the zigzag delta of
+    each temperature, in buckets:
+
+        timestamp   0 = 0, 10 + 7 bits, 110 + 9 bits, 1110 + 12 bits, 1111 + 32 bits
+        temperature 0 = 0, 10 + 4 bits, 110 + 8 bits, 111 + 17 bits
+
+    T0 produces a sample every 15625 ticks at a steady rate, so the
+    timestamp delta-of-delta is almost always 0 or a few ticks of main loop
+    jitter (1 to 9 bits). A temperature that drifts by a few hundredths per
+    sample costs 6 bits. tools/test_log_codec.c measures 2.19 to 3.97
+    bytes per sample on a simulated brewing week (sensor noise of 0.5 to 8
+    hundredths), and 3.04 to 10.80 on random walks with steps of 3 to 5000
+    hundredths. Encoding is a handful of shifts per field; a PROFILE_ISR
+    build reports its worst case in cycles.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "log_ring.h"
+#include "log_codec.h"
+
+#if LOG_CODEC == LOG_CODEC_GORILLA
+
+/*! \brief Appends the low n bits of value to the bitstream (n <= 24)
+ */
+
+static void log_put_bits(logEncoder *pEnc, unsigned long value, unsigned char n) {
+    pEnc->bits = (pEnc->bits << n) | (value & ((1UL << n) - 1));
+    pEnc->nbits += n;
+    while(pEnc->nbits >= 8) {
+        pEnc->nbits -= 8;
+        if(pEnc->length < pEnc->max) {
+            pEnc->pOut[pEnc->length++] = pEnc->bits >> pEnc->nbits;
+        } else {
+            pEnc->full = 1;
+        }
+    }
+}
+
+/*! \brief Reads the next n bits of the bitstream (n <= 24)
+ */
+
+static unsigned char log_get_bits(logDecoder *pDec, unsigned long *pValue, unsigned char n) {
+    while(pDec->nbits < n) {
+        if(pDec->length == 0)
+            return 1; /*! \return 1 = payload ends inside the field */
+        pDec->bits = (pDec->bits << 8) | *pDec->pIn++;
+        pDec->length--;
+        pDec->nbits += 8;
+    }
+    pDec->nbits -= n;
+    *pValue = (pDec->bits >> pDec->nbits) & ((1UL << n) - 1);
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Zigzag codes a 32 bit two's complement value
+ */
+
+static unsigned long log_zigzag(unsigned long value) {
+    value &= 0xFFFFFFFFUL;
+    return ((value << 1) ^ (0 - (value >> 31))) & 0xFFFFFFFFUL;
+}
+
+/*! \brief Undoes log_zigzag()
+ */
+
+static unsigned long log_unzigzag(unsigned long value) {
+    return ((value >> 1) ^ (0 - (value & 1))) & 0xFFFFFFFFUL;
+}
+
+/*! \brief Starts an empty payload
+ */
+
+void log_encode_init(logEncoder *pEnc, unsigned char *pOut, unsigned int max) {
+    pEnc->pOut = pOut;
+    pEnc->length = 2; //sample count, filled in by log_encode_finish()
+    pEnc->max = max;
+    pEnc->count = 0;
+    pEnc->bits = 0;
+    pEnc->nbits = 0;
+    pEnc->full = 0;
+}
+
+/*! \brief Appends a sample to the payload
+ */
+
+unsigned char log_encode(logEncoder *pEnc, logSample *pSample) {
+    unsigned int length = pEnc->length;
+    unsigned long bits = pEnc->bits;
+    unsigned char nbits = pEnc->nbits;
+    unsigned long delta = 0;
+    unsigned long code;
+    unsigned char inc;
+
+    if(pEnc->count == 0) {
+        log_put_bits(pEnc, pSample->timestamp >> 16, 16);
+        log_put_bits(pEnc, pSample->timestamp, 16);
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            log_put_bits(pEnc, pSample->temp[inc], 16);
+        }
+    } else {
+        delta = (pSample->timestamp - pEnc->timestamp) & 0xFFFFFFFFUL;
+        code = log_zigzag(delta - pEnc->delta);
+        if(code == 0) {
+            log_put_bits(pEnc, 0b0, 1);
+        } else if(code < (1UL << 7)) {
+            log_put_bits(pEnc, (0b10UL << 7) | code, 2 + 7);
+        } else if(code < (1UL << 9)) {
+            log_put_bits(pEnc, (0b110UL << 9) | code, 3 + 9);
+        } else if(code < (1UL << 12)) {
+            log_put_bits(pEnc, (0b1110UL << 12) | code, 4 + 12);
+        } else {
+            log_put_bits(pEnc, 0b1111, 4);
+            log_put_bits(pEnc, code >> 16, 16);
+            log_put_bits(pEnc, code, 16);
+        }
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            code = log_zigzag((long)pSample->temp[inc] - pEnc->temp[inc]);
+            if(code == 0) {
+                log_put_bits(pEnc, 0b0, 1);
+            } else if(code < (1UL << 4)) {
+                log_put_bits(pEnc, (0b10UL << 4) | code, 2 + 4);
+            } else if(code < (1UL << 8)) {
+                log_put_bits(pEnc, (0b110UL << 8) | code, 3 + 8);
+            } else {
+                log_put_bits(pEnc, (0b111UL << 17) | code, 3 + 17);
+            }
+        }
+    }
+
+    if(pEnc->full || pEnc->length + (pEnc->nbits != 0) > pEnc->max) {
+        pEnc->length = length; //roll the writer back to before the sample
+        pEnc->bits = bits;
+        pEnc->nbits = nbits;
+        pEnc->full = 0;
+        return 1; /*! \return 1 = payload full, sample not added */
+    }
+
+    pEnc->count++;
+    pEnc->timestamp = pSample->timestamp;
+    pEnc->delta = delta;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pEnc->temp[inc] = pSample->temp[inc];
+    }
+    return 0; /*! \return 0 = sample added */
+}
+
+/*! \brief Flushes the last bits and stores the sample count
+ */
+
+unsigned int log_encode_finish(logEncoder *pEnc) {
+    if(pEnc->nbits != 0) {
+        pEnc->pOut[pEnc->length++] = pEnc->bits << (8 - pEnc->nbits); //log_encode() left room
+        pEnc->nbits = 0;
+    }
+    pEnc->pOut[0] = pEnc->count;
+    pEnc->pOut[1] = pEnc->count >> 8;
+    return pEnc->length; /*! \return payload length in bytes */
+}
+
+/*! \brief Starts reading a payload
+ */
+
+void log_decode_init(logDecoder *pDec, unsigned char *pIn, unsigned int length) {
+    pDec->pIn = pIn + 2;
+    pDec->length = length < 2 ? 0 : length - 2;
+    pDec->total = length < 2 ? 0 : pIn[0] | (pIn[1] << 8);
+    pDec->count = 0;
+    pDec->bits = 0;
+    pDec->nbits = 0;
+}
+
+/*! \brief Reads the next sample of a payload
+ */
+
+unsigned char log_decode(logDecoder *pDec, logSample *pSample) {
+    unsigned long value;
+    unsigned long high;
+    unsigned char prefix;
+    unsigned char inc;
+
+    if(pDec->count >= pDec->total)
+        return 1; /*! \return 1 = no more samples */
+
+    if(pDec->count == 0) {
+        if(log_get_bits(pDec, &high, 16) || log_get_bits(pDec, &value, 16))
+            return 2; /*! \return 2 = corrupt payload */
+        pDec->timestamp = (high << 16) | value;
+        pDec->delta = 0;
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            if(log_get_bits(pDec, &value, 16))
+                return 2;
+            pDec->temp[inc] = (int)(short)value; //sign extend
+        }
+    } else {
+        for(prefix = 0; prefix < 4; prefix++) { //count the 1s of the bucket prefix
+            if(log_get_bits(pDec, &value, 1))
+                return 2;
+            if(value == 0)
+                break;
+        }
+        if(prefix == 0) {
+            value = 0;
+        } else if(prefix < 4) {
+            if(log_get_bits(pDec, &value, prefix == 1 ? 7 : prefix == 2 ? 9 : 12))
+                return 2;
+        } else {
+            if(log_get_bits(pDec, &high, 16) || log_get_bits(pDec, &value, 16))
+                return 2;
+            value |= high << 16;
+        }
+        pDec->delta = (pDec->delta + log_unzigzag(value)) & 0xFFFFFFFFUL;
+        pDec->timestamp = (pDec->timestamp + pDec->delta) & 0xFFFFFFFFUL; //the timebase wraps at 32 bits
+
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            for(prefix = 0; prefix < 3; prefix++) {
+                if(log_get_bits(pDec, &value, 1))
+                    return 2;
+                if(value == 0)
+                    break;
+            }
+            value = 0;
+            if(prefix != 0 && log_get_bits(pDec, &value, prefix == 1 ? 4 : prefix == 2 ? 8 : 17))
+                return 2;
+            pDec->temp[inc] += log_unzigzag(value);
+        }
+    }
+
+    pDec->count++;
+    pSample->timestamp = pDec->timestamp;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pSample->temp[inc] = pDec->temp[inc];
+    }
+    return 0; /*! \return 0 = sample read */
+}
+
+#else //LOG_CODEC_VARINT
+
+/*! \brief Appends a varint
+ */
+
+static unsigned char log_put_varint(unsigned char *pOut, unsigned long value) {
+    unsigned char length = 0;
+
+    while(value >= 0x80) {
+        pOut[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    pOut[length++] = value;
+    return length; /*! \return bytes written */
+}
+
+/*! \brief Reads a varint
+ */
+
+static unsigned char log_get_varint(logDecoder *pDec, unsigned long *pValue) {
+    unsigned long value = 0;
+    unsigned char shift = 0;
+    unsigned char data;
+
+    do {
+        if(pDec->length == 0 || shift > 28)
+            return 1; /*! \return 1 = payload ends inside the varint */
+        data = *pDec->pIn++;
+        pDec->length--;
+        value |= (unsigned long)(data & 0x7F) << shift;
+        shift += 7;
+    } while(data & 0x80);
+
+    *pValue = value;
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Starts an empty payload
+ */
+
+void log_encode_init(logEncoder *pEnc, unsigned char *pOut, unsigned int max) {
+    pEnc->pOut = pOut;
+    pEnc->length = 0;
+    pEnc->max = max;
+    pEnc->count = 0;
+}
+
+/*! \brief Appends a sample to the payload
+ */
+
+unsigned char log_encode(logEncoder *pEnc, logSample *pSample) {
+    unsigned char sample[LOG_SAMPLE_MAX];
+    unsigned char length = 0;
+    unsigned char inc;
+    long delta;
+
+    if(pEnc->count == 0) {
+        sample[length++] = pSample->timestamp;
+        sample[length++] = pSample->timestamp >> 8;
+        sample[length++] = pSample->timestamp >> 16;
+        sample[length++] = pSample->timestamp >> 24;
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            sample[length++] = pSample->temp[inc];
+            sample[length++] = pSample->temp[inc] >> 8;
+        }
+    } else {
+        length += log_put_varint(&sample[length], (pSample->timestamp - pEnc->timestamp) & 0xFFFFFFFFUL);
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            delta = (long)pSample->temp[inc] - pEnc->temp[inc];
+            length += log_put_varint(&sample[length], (delta << 1) ^ (delta >> 31)); //zigzag
+        }
+    }
+
+    if(pEnc->length + length > pEnc->max)
+        return 1; /*! \return 1 = payload full, sample not added */
+
+    for(inc = 0; inc < length; inc++) {
+        pEnc->pOut[pEnc->length++] = sample[inc];
+    }
+    pEnc->count++;
+    pEnc->timestamp = pSample->timestamp;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pEnc->temp[inc] = pSample->temp[inc];
+    }
+    return 0; /*! \return 0 = sample added */
+}
+
+/*! \brief Returns the payload length (varints need no flushing)
+ */
+
+unsigned int log_encode_finish(logEncoder *pEnc) {
+    return pEnc->length; /*! \return payload length in bytes */
+}
+
+/*! \brief Starts reading a payload
+ */
+
+void log_decode_init(logDecoder *pDec, unsigned char *pIn, unsigned int length) {
+    pDec->pIn = pIn;
+    pDec->length = length;
+    pDec->count = 0;
+}
+
+/*! \brief Reads the next sample of a payload
+ */
+
+unsigned char log_decode(logDecoder *pDec, logSample *pSample) {
+    unsigned long value;
+    unsigned char inc;
+
+    if(pDec->length == 0)
+        return 1; /*! \return 1 = no more samples */
+
+    if(pDec->count == 0) {
+        if(pDec->length < 4 + 2*ADC_NUM_CHANNELS)
+            return 2; /*! \return 2 = corrupt payload */
+        pDec->timestamp = pDec->pIn[0] | ((unsigned long)pDec->pIn[1] << 8)
+                | ((unsigned long)pDec->pIn[2] << 16) | ((unsigned long)pDec->pIn[3] << 24);
+        pDec->pIn += 4;
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            pDec->temp[inc] = (signed char)pDec->pIn[1] * 256 + pDec->pIn[0];
+            pDec->pIn += 2;
+        }
+        pDec->length -= 4 + 2*ADC_NUM_CHANNELS;
+    } else {
+        if(log_get_varint(pDec, &value) != 0)
+            return 2;
+        pDec->timestamp = (pDec->timestamp + value) & 0xFFFFFFFFUL; //the timebase wraps at 32 bits
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            if(log_get_varint(pDec, &value) != 0)
+                return 2;
+            pDec->temp[inc] += (value >> 1) ^ -(long)(value & 1); //undo zigzag
+        }
+    }
+
+    pDec->count++;
+    pSample->timestamp = pDec->timestamp;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pSample->temp[inc] = pDec->temp[inc];
+    }
+    return 0; /*! \return 0 = sample read */
+}
+
+#endif
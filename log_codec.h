@@ -0,0 +1,41 @@
+
+#ifndef INC_LOG_CODEC_H
+#define INC_LOG_CODEC_H
+
+#define LOG_SAMPLE_MAX  (5 + 3*ADC_NUM_CHANNELS) ///longest encoded sample (LOG_CODEC_VARINT: 5 byte timestamp delta, 3 bytes per channel)
+
+/* Packs samples into a record block payload. The first sample is stored
+ * whole (timestamp and base temperatures) and every later one relative to
+ * the sample before it, so each payload decodes on its own. */
+typedef struct logEncoder {
+    unsigned char *pOut; //payload being filled
+    unsigned int length; //bytes used
+    unsigned int max; //payload size
+    unsigned int count; //samples in the payload
+    unsigned long timestamp; //previous sample
+    unsigned long delta; //previous timestamp delta (LOG_CODEC_GORILLA)
+    int temp[ADC_NUM_CHANNELS];
+    unsigned long bits; //bit writer, the low nbits are not stored yet (LOG_CODEC_GORILLA)
+    unsigned char nbits;
+    unsigned char full; //a byte did not fit
+}logEncoder;
+
+typedef struct logDecoder {
+    unsigned char *pIn; //payload being read
+    unsigned int length; //bytes left
+    unsigned int count; //samples decoded
+    unsigned int total; //samples in the payload (LOG_CODEC_GORILLA)
+    unsigned long timestamp; //previous sample
+    unsigned long delta; //previous timestamp delta (LOG_CODEC_GORILLA)
+    int temp[ADC_NUM_CHANNELS];
+    unsigned long bits; //bit reader, the low nbits are not used yet (LOG_CODEC_GORILLA)
+    unsigned char nbits;
+}logDecoder;
+
+void log_encode_init(logEncoder *pEnc, unsigned char *pOut, unsigned int max);
+unsigned char log_encode(logEncoder *pEnc, logSample *pSample);
+unsigned int log_encode_finish(logEncoder *pEnc);
+void log_decode_init(logDecoder *pDec, unsigned char *pIn, unsigned int length);
+unsigned char log_decode(logDecoder *pDec, logSample *pSample);
+
+#endif
@@ -0,0 +1,87 @@
+/*! \file log_ring.c
+    \brief Lock-free byte ring of logged samples on their way to the SD card
+
+    Single producer (temperature_task() appends one sample per T0 reading)
+    and single consumer (logger_task() reads ahead a block's worth of
+    samples). Either side may run from an interrupt. As with
+    adc_queue.c the producer only writes log_ring_head and the consumer only
+    writes log_ring_tail. Both are free-running 16 bit byte counts, so every
+    access is atomic and head - tail is the fill level even after they wrap.
+
+    Samples are packed back to back in the sram.h staging memory. It is
+    reached through memory_block() one BLOCK_SIZE window at a time, so a
+    sample that crosses a block boundary fetches the next window. The
+    address register of memory_read()/memory_write() is not used, so
+    the producer may run from an interrupt. The consumer releases samples
+    only once they are safely on the card, so a failed write can be retried
+    from the ring.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "sram.h"
+#include "log_ring.h"
+
+static volatile unsigned int log_ring_head = 0; ///bytes the producer has written
+static volatile unsigned int log_ring_tail = 0; ///bytes the logger has released
+volatile unsigned int log_ring_overflows = 0; ///samples dropped because the ring was full
+
+/*! \brief Appends a sample (producer only)
+ *
+ *  A sample that does not fit is dropped whole, so the ring stays aligned
+ *  to samples.
+ */
+
+unsigned char log_ring_push(logSample *pSample) {
+    unsigned int head = log_ring_head;
+    unsigned char *pData = (unsigned char *)pSample;
+    volatile unsigned char *window = memory_block(head);
+    unsigned char inc;
+
+    if(LOG_RING_SIZE - (head - log_ring_tail) < LOG_RECORD_SIZE) {
+        log_ring_overflows++;
+        return 1; /*! \return 1 = ring full, sample dropped */
+    }
+
+    for(inc = 0; inc < LOG_RECORD_SIZE; inc++) {
+        window[head & (BLOCK_SIZE-1)] = pData[inc];
+        if((++head & (BLOCK_SIZE-1)) == 0) {
+            window = memory_block(head); //crossed into the next block
+        }
+    }
+    log_ring_head = head; //publish only after the sample is complete
+
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Copies out the sample offset bytes past the oldest one (consumer only)
+ *
+ *  Samples stay in the ring, and the producer will not overwrite them,
+ *  until log_ring_release() is called.
+ */
+
+unsigned char log_ring_read(unsigned int offset, logSample *pSample) {
+    unsigned int tail = log_ring_tail + offset;
+    unsigned char *pData = (unsigned char *)pSample;
+    volatile unsigned char *window = memory_block(tail);
+    unsigned char inc;
+
+    if(log_ring_head - tail < LOG_RECORD_SIZE) {
+        return 1; /*! \return 1 = no sample buffered at offset */
+    }
+    for(inc = 0; inc < LOG_RECORD_SIZE; inc++) {
+        pData[inc] = window[tail & (BLOCK_SIZE-1)];
+        if((++tail & (BLOCK_SIZE-1)) == 0) {
+            window = memory_block(tail);
+        }
+    }
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Frees the oldest length bytes (samples already on the card)
+ */
+
+void log_ring_release(unsigned int length) {
+    log_ring_tail += length;
+}
@@ -0,0 +1,20 @@
+
+#ifndef INC_LOG_RING_H
+#define INC_LOG_RING_H
+
+#define LOG_RING_SIZE SRAM_SIZE ///bytes in the ring (all of the staging memory)
+#define LOG_RECORD_SIZE sizeof(logSample) ///bytes appended per sample
+
+/* One logged sample: every probe at the moment a new T0 reading comes out */
+typedef struct logSample {
+    unsigned long timestamp; //timebase_read() of the ADC block behind the T0 reading
+    int temp[ADC_NUM_CHANNELS]; //hundredths of a degree C indexed by T0_PROBE..T2_PROBE
+}logSample;
+
+extern volatile unsigned int log_ring_overflows;
+
+unsigned char log_ring_push(logSample *pSample);
+unsigned char log_ring_read(unsigned int offset, logSample *pSample);
+void log_ring_release(unsigned int length);
+
+#endif
@@ -0,0 +1,305 @@
+/*! \file logger.c
+    \brief Append-only log of temperature samples on the SD card
+
+    The card holds a superblock and then numbered, CRC-protected record
+    blocks (see LOG_FORMAT in logger.h). A block is never rewritten, so after
+    a reset or brownout logger_init() only has to find the end of the log:
+    it gallops out (n = 1, 2, 4, ...) until it reaches a block that is not
+    valid for this volume and then bisects. Finding the head of a log of n
+    blocks takes about 2*log2(n) block reads, which is under 60 reads (tens
+    of milliseconds) even on a full 32 GB card.
+
+    logger_task() runs from the main loop. It packs samples from the log
+    ring in the LOG_CODEC format (by default the Gorilla-style delta-of-delta
+    bitstream, see log_codec.c) straight into the SD DMA buffer until the
+    next one no longer fits, then hands the block to the non-blocking SD
+    writer, one block in flight at a time. The samples are released from
+    the ring only once the card has the block.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "log_ring.h"
+#include "log_codec.h"
+#include "spi_sd.h"
+#include "sd_async.h"
+#include "rtc.h"
+#include "timebase.h"
+#include "logger.h"
+
+static unsigned char logger_ready = 0; ///1 once logger_init() has found the head of the log
+static unsigned long logger_first = 0; ///card address of record block 0
+static unsigned long logger_end = 0; ///card address past the last block on the card
+static unsigned long logger_volume = 0; ///volume id from the superblock
+static unsigned long logger_seq = 0; ///sequence number of the next record block
+static unsigned char logger_built = 0; ///1 while the DMA buffer holds block logger_seq
+static logEncoder logger_enc; ///payload of block logger_seq
+static unsigned int logger_offset = 0; ///ring bytes packed into logger_enc
+static unsigned char logger_attempts = 0; ///failed writes of the current block
+unsigned int logger_lost_blocks = 0; ///blocks skipped after LOGGER_ATTEMPTS failures
+unsigned char logger_card_full = 0; ///1 once the log has reached the end of the card
+#if PROFILE_ISR
+unsigned int logger_encode_max_cycles = 0; ///worst case log_encode() length (instruction cycles)
+#endif
+
+/*! \brief CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF)
+ */
+
+static unsigned int log_crc(unsigned char *pData, unsigned int length) {
+    unsigned int crc = 0xFFFF;
+
+    while(length--) {
+        crc = (crc >> 8) | (crc << 8);
+        crc ^= *pData++;
+        crc ^= (crc & 0xFF) >> 4;
+        crc ^= crc << 12;
+        crc ^= (crc & 0xFF) << 5;
+    }
+    return crc; /*! \return CRC of the bytes */
+}
+
+/*! \brief Stores a little endian value (the DMA buffer is not word aligned)
+ */
+
+static void log_put(unsigned char *pData, unsigned long value, unsigned char length) {
+    while(length--) {
+        *pData++ = value;
+        value >>= 8;
+    }
+}
+
+/*! \brief Loads a little endian value
+ */
+
+static unsigned long log_get(unsigned char *pData, unsigned char length) {
+    unsigned long value = 0;
+
+    pData += length;
+    while(length--) {
+        value = (value << 8) | *--pData;
+    }
+    return value; /*! \return the value */
+}
+
+/*! \brief Checks a block's CRC
+ */
+
+static unsigned char log_crc_ok(unsigned char *block) {
+    return log_crc(block, LOG_CRC_OFFSET) == log_get(&block[LOG_CRC_OFFSET], 2); /*! \return 1 = CRC matches */
+}
+
+/*! \brief Reads a block, retrying a failed read
+ */
+
+static unsigned char log_read(unsigned long address, unsigned char *block) {
+    unsigned char inc;
+
+    for(inc = 0; inc < LOGGER_READ_ATTEMPTS; inc++) {
+        if(SD_ReadBlock(address, block) == 0)
+            return 0; /*! \return 0 = block read */
+    }
+    return 1; /*! \return 1 = every attempt failed */
+}
+
+/*! \brief Reads record block n and checks that it belongs to this log
+ */
+
+static unsigned char log_valid(unsigned long n) {
+    unsigned char *block = SD_DMABuffer();
+
+    if(logger_first + n >= logger_end)
+        return 0; //past the end of the card
+    if(log_read(logger_first + n, block) != 0)
+        return 2; /*! \return 2 = the block could not be read */
+    return log_get(&block[0], 4) == logger_volume
+        && log_get(&block[4], 4) == n
+        && log_get(&block[8], 2) <= LOG_PAYLOAD_MAX
+        && log_crc_ok(block); /*! \return 1 = valid block n, 0 = not valid */
+}
+
+/*! \brief Finds the first block that is not valid
+ *
+ *  Valid blocks run from 0 up to the head, so the head is found by
+ *  galloping to an invalid block and bisecting. A write that failed
+ *  LOGGER_ATTEMPTS times leaves one bad block inside the log, so the
+ *  LOG_RECOVER_PROBE blocks after a candidate head are checked as well.
+ *  A block that cannot be read is not taken as invalid, since that would
+ *  put the head inside the log and later blocks would overwrite it.
+ */
+
+static unsigned char log_find_head(unsigned long *pHead) {
+    unsigned long lo = 0; //every block below lo is valid
+    unsigned long hi = 0; //block being tested, then a block known to be invalid
+    unsigned long step;
+    unsigned long mid;
+    unsigned char valid;
+    unsigned char inc;
+
+    while(1) {
+        step = 1;
+        while((valid = log_valid(hi)) == 1) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        if(valid == 2)
+            return 1; /*! \return 1 = a block could not be read */
+        while(lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            valid = log_valid(mid);
+            if(valid == 2)
+                return 1;
+            if(valid) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        //blocks below lo are valid and block lo is not
+        for(inc = 1; inc <= LOG_RECOVER_PROBE; inc++) {
+            valid = log_valid(lo + inc);
+            if(valid == 2)
+                return 1;
+            if(valid) break;
+        }
+        if(inc > LOG_RECOVER_PROBE) {
+            *pHead = lo;
+            return 0; /*! \return 0 = *pHead is the number of the first free record block */
+        }
+        lo += inc + 1; //skip the bad block and carry on from the valid one
+        hi = lo;
+    }
+}
+
+/*! \brief Opens the log (call after sd_init() succeeds)
+ *
+ *  Reads the card size and the superblock at address and resumes after the
+ *  last block written. A card whose superblock is for another version,
+ *  record size or codec is formatted with the next volume id, so none of
+ *  its old blocks match. A card with no superblock at all gets a volume id
+ *  packed from the RTC time. A read that still fails after
+ *  LOGGER_READ_ATTEMPTS tries stops here without writing anything, so a
+ *  flaky read at boot can never format over a log. The SD DMA buffer is
+ *  used for the reads, and everything here blocks, so call it once at
+ *  power up.
+ */
+
+unsigned char logger_init(unsigned long address, timeData *pTime) {
+    unsigned char *block = SD_DMABuffer();
+    unsigned char found;
+    unsigned int inc;
+
+    logger_ready = 0;
+    if(SD_ReadCapacity(&logger_end) != 0 || logger_end <= address + 1)
+        return 2; /*! \return 2 = could not read the card size, or no room for a record block */
+    logger_first = address + 1;
+    logger_card_full = 0;
+
+    if(log_read(address, block) != 0)
+        return 3; /*! \return 3 = a block could not be read, nothing was written */
+    found = log_get(&block[0], 4) == LOG_MAGIC
+            && log_crc_ok(block);
+    if(found
+            && log_get(&block[4], 2) == LOG_VERSION
+            && log_get(&block[6], 2) == LOG_RECORD_SIZE
+            && log_get(&block[12], 2) == LOG_CODEC) {
+        logger_volume = log_get(&block[8], 4);
+        if(log_find_head(&logger_seq) != 0)
+            return 3;
+    } else {
+        if(found) {
+            logger_volume = log_get(&block[8], 4) + 1; //every old block carries the old volume
+        } else {
+            logger_volume = ((unsigned long)(pTime->year & 0x3F) << 26) | ((unsigned long)(pTime->month & 0x0F) << 22)
+                    | ((unsigned long)(pTime->day & 0x1F) << 17) | ((unsigned long)(pTime->hours & 0x1F) << 12)
+                    | ((unsigned long)(pTime->minutes & 0x3F) << 6) | (pTime->seconds & 0x3F);
+        }
+        for(inc = 0; inc < BLOCK_SIZE; inc++) {
+            block[inc] = 0;
+        }
+        log_put(&block[0], LOG_MAGIC, 4);
+        log_put(&block[4], LOG_VERSION, 2);
+        log_put(&block[6], LOG_RECORD_SIZE, 2);
+        log_put(&block[8], logger_volume, 4);
+        log_put(&block[12], LOG_CODEC, 2);
+        log_put(&block[LOG_CRC_OFFSET], log_crc(block, LOG_CRC_OFFSET), 2);
+        if(SD_WriteBlock(address, block) != 0)
+            return 1; /*! \return 1 = could not write the superblock */
+        logger_seq = 0;
+    }
+
+    logger_built = 0;
+    logger_offset = 0;
+    log_encode_init(&logger_enc, &block[LOG_HEADER_SIZE], LOG_PAYLOAD_MAX);
+    logger_attempts = 0;
+    logger_ready = 1;
+    return 0; /*! \return 0 = logging resumes at block logger_seq */
+}
+
+/*! \brief Packs new samples and writes each full block (call from the main loop)
+ */
+
+void logger_task(void) {
+    unsigned char *block = SD_DMABuffer();
+    logSample sample;
+    unsigned int inc;
+    unsigned char full;
+#if PROFILE_ISR
+    unsigned int profile_cycles;
+#endif
+
+    if(!logger_ready) return;
+
+    switch(sd_async_poll()) {
+    case SD_ASYNC_IDLE:
+        if(logger_first + logger_seq >= logger_end) {
+            logger_card_full = 1; //stop here, the ring fills and counts the dropped samples
+            logger_ready = 0;
+            sd_async_close();
+            return;
+        }
+        if(!logger_built) {
+            while(1) {
+                if(log_ring_read(logger_offset, &sample) != 0)
+                    return; //wait until the block is full
+#if PROFILE_ISR
+                PROFILE_START(profile_cycles);
+#endif
+                full = log_encode(&logger_enc, &sample);
+#if PROFILE_ISR
+                PROFILE_END(profile_cycles, logger_encode_max_cycles);
+#endif
+                if(full)
+                    break;
+                logger_offset += LOG_RECORD_SIZE;
+            }
+            log_put(&block[8], log_encode_finish(&logger_enc), 2);
+            log_put(&block[0], logger_volume, 4);
+            log_put(&block[4], logger_seq, 4);
+            for(inc = LOG_HEADER_SIZE + logger_enc.length; inc < LOG_CRC_OFFSET; inc++) {
+                block[inc] = 0;
+            }
+            log_put(&block[LOG_CRC_OFFSET], log_crc(block, LOG_CRC_OFFSET), 2);
+            logger_built = 1;
+        }
+        sd_async_submit(logger_first + logger_seq, block);
+        break;
+
+    case SD_ASYNC_DONE:
+    case SD_ASYNC_ERROR:
+        if(sd_async_complete() != 0 && ++logger_attempts < LOGGER_ATTEMPTS) {
+            break; //retry the same block
+        }
+        if(logger_attempts >= LOGGER_ATTEMPTS) {
+            logger_lost_blocks++;
+        }
+        logger_attempts = 0;
+        logger_built = 0;
+        log_ring_release(logger_offset);
+        logger_offset = 0;
+        log_encode_init(&logger_enc, &block[LOG_HEADER_SIZE], LOG_PAYLOAD_MAX);
+        logger_seq++;
+        break;
+    }
+}
@@ -0,0 +1,43 @@
+
+#ifndef INC_LOGGER_H
+#define INC_LOGGER_H
+
+#define LOGGER_ATTEMPTS 3 ///tries per block before it is skipped
+#define LOGGER_READ_ATTEMPTS 3 ///tries per block read while logger_init() looks for the log
+
+/** @defgroup LOG_FORMAT SD card log format
+ *
+ *  Block SD_START_ADDRESS is the superblock. Record blocks follow it and
+ *  block n of the log lives at SD_START_ADDRESS + 1 + n. All fields are
+ *  little endian and every block ends with a CRC-16/CCITT (0x1021, initial
+ *  value 0xFFFF) of the bytes in front of it.
+ *
+ *  Superblock: magic(4) version(2) record size(2) volume(4) codec(2) ... CRC(2)
+ *  Record block: volume(4) sequence(4) payload length(2) payload ... CRC(2)
+ *  The payload is a run of samples packed by log_codec.c in the LOG_CODEC
+ *  format named by the superblock. A card written with another codec is
+ *  formatted again.
+ *
+ *  The volume is chosen when the card is formatted, so blocks left over from
+ *  an older log never look valid: one more than the old superblock's volume,
+ *  or the RTC time when the card has no superblock. A record block's
+ *  sequence number equals n. Logging stops at the end of the card (CSD size).
+ * @{ */
+#define LOG_MAGIC           0x474F4C46UL ///"FLOG"
+#define LOG_VERSION         3 ///superblock names the payload codec
+#define LOG_HEADER_SIZE     10 ///record block header bytes
+#define LOG_PAYLOAD_MAX     (BLOCK_SIZE - LOG_HEADER_SIZE - 2) ///record block payload bytes
+#define LOG_CRC_OFFSET      (BLOCK_SIZE - 2) ///CRC position in every block
+#define LOG_RECOVER_PROBE   4 ///blocks checked past the head for a block lost to a failed write
+/** @} */
+
+extern unsigned int logger_lost_blocks;
+extern unsigned char logger_card_full;
+#if PROFILE_ISR
+extern unsigned int logger_encode_max_cycles;
+#endif
+
+unsigned char logger_init(unsigned long address, timeData *pTime);
+void logger_task(void);
+
+#endif
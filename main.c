@@ -11,13 +11,18 @@
 #include "spi_sd.h"
 #include "globals.h"
 #include "init.h"
-#include "temp_lookup.h"
 #include "display.h"
 #include <i2c.h>
 #include "i2c.h"
 #include <libpic30.h> //for delays
 #include "uart.h"
 #include "rtc.h"
+#include "timebase.h"
+#include "adc_queue.h"
+#include "temperature.h"
+#include "sd_async.h"
+#include "log_ring.h"
+#include "logger.h"
 
 /* CONFIG SETTINGS  */
 //see section 22.1 of the PIC33FJ256GP510A datasheet for config settings
@@ -30,9 +35,9 @@ _FICD( ICS_PGD2 & JTAGEN_OFF ) //jtag disabled, communicate on PGED/C 1
 /* STATIC VARIABLES */
 static unsigned char LCD_dots = 0;
 static unsigned int LCD_value = 0;
-static unsigned int T0_temp = 0;
-static unsigned int T1_temp = 0;
-static unsigned int T2_temp = 0;
+#if PROFILE_ISR
+static volatile unsigned int dma1_isr_max_cycles = 0; ///worst case _DMA1Interrupt() length (instruction cycles)
+#endif
 
 
 /* FUNCTION PROTOTYPES*/
@@ -64,17 +69,14 @@ void error(unsigned int error_num) {
     }
 }
 
-/*! \brief DMA0 ISR - formats ADC sample and writes it to memory
+/*! \brief DMA0 ISR - sd card block transfer complete
  *
  *	_DMA0Interrupt() is the DMA channel 0 interrupt service routine (ISR).
- *      DMA is used to retrieve information from the ADC DMA buffer. Since the
- *      ADC requires an external clock (which it gets from the SPI2 clock) it
- *      would require too much of the cpu's time to wait for the SPI clock to
- *      complete the transfer. The TIMER2 interrupt starts the DMA transfer.
- *      This function takes the information in stored in the buffer, formats it,
- *      and stores it in the global variable 'sample' where it is processed by
- *      the timer2 ISR. This introduces a 1 sample "lag" in the record.
+ *      DMA2 streams a block to the SD card through SPI1 while DMA0 drains the
+ *      SPI1 receive buffer. DMA0 finishes when the last byte has been clocked
+ *      out, and SD_WriteDMAEnd() can then collect the card's data response.
  *
+ *  \sa SD_WriteMultiBlockDMA()
  */
 
 
@@ -82,132 +84,100 @@ void __attribute__((__interrupt__, auto_psv)) _DMA0Interrupt(void)
 {
 
     DMA0_FLAG = 0;
+    SD_DMAComplete();
     return;
     
 }
 
 
-/*! \brief DMA1 ISR - formats ADC sample and writes it to memory
+/*! \brief Sums one channel's block of conversions from an ADC DMA buffer
  *
- *	_DMA0Interrupt() is the DMA channel 0 interrupt service routine (ISR). DMA is used to retrieve information from the ADC DMA buffer. Since the ADC requires an external clock (which it gets from the SPI2 clock) it would require too much of the cpu's time to wait for the SPI clock to complete the transfer. The TIMER2 interrupt starts the DMA transfer. This function takes the information in stored in the buffer, formats it, and stores it in the global variable 'sample' where it is processed by the timer2 ISR. This introduces a 1 sample "lag" in the record.
+ *  In scan mode the ADC writes each input into its own ADC_BLOCK_LENGTH word
+ *  slot of the DMA buffer (peripheral indirect addressing), so the block for
+ *  ANx starts at adc_buf[x*ADC_BLOCK_LENGTH].
  *
+ *  In simultaneous mode the buffer holds ADC_BLOCK_LENGTH sequences of
+ *  CH0..CH3 in conversion order. CHx samples AN(x+2) (CH123SA = 1) and CH0
+ *  doubles up on the thermocouple. The 10-bit sums are scaled up so every
+ *  mode returns the same full scale as 16 12-bit samples.
  */
 
-
-void __attribute__((__interrupt__, auto_psv)) _DMA1Interrupt(void)
-{
+static unsigned int adc_block_sum(unsigned int *adc_buf, unsigned char channel) {
     unsigned int adc_accum = 0;
-    unsigned int lookup_count = 0;
-    unsigned int lcd_value_rounded = 0;
-    unsigned int adc_high = 0;
-    unsigned int adc_low = 0;
-    unsigned int range = 0;
-    unsigned int fraction = 0;
+    unsigned int inc = 0;
 
-    LED3 = 1;
-    LED4 = 1;
-    adc_accum += (int)*(&dma_adc_buf);
-    adc_accum += (int)*(&dma_adc_buf+1);
-    adc_accum += (int)*(&dma_adc_buf+2);
-    adc_accum += (int)*(&dma_adc_buf+3);
-    adc_accum += (int)*(&dma_adc_buf+4);
-    adc_accum += (int)*(&dma_adc_buf+5);
-    adc_accum += (int)*(&dma_adc_buf+6);
-    adc_accum += (int)*(&dma_adc_buf+7);
-    adc_accum += (int)*(&dma_adc_buf+8);
-    adc_accum += (int)*(&dma_adc_buf+9);
-    adc_accum += (int)*(&dma_adc_buf+10);
-    adc_accum += (int)*(&dma_adc_buf+11);
-    adc_accum += (int)*(&dma_adc_buf+12);
-    adc_accum += (int)*(&dma_adc_buf+13);
-    adc_accum += (int)*(&dma_adc_buf+14);
-    adc_accum += (int)*(&dma_adc_buf+15);
-
-    if(ADC_SOURCE == T1_AN || ADC_SOURCE == T2_AN) {
-        /*T1_AN and T2_AN are thermistor inputs (100k)*/
-
-        /* Note: the thermistors are currently implemented using a lookup table
-         * with linear interpolation between the steps of the table.
-         *
-         * In the future we can (and should) leverage the power of the dsPic to
-         * calculate the temperature directly.  */
-       
-        /*Navigate the lookup table until we've gone over the ADC reading*/
-        while(adc_accum < *(&lookup_adc_0+lookup_count) && lookup_count < LOOKUP_0_LENGTH) {
-            lookup_count++;
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+    for(inc = 0; inc < ADC_DMA_BUF_LENGTH; inc += ADC_SIMSAM_CHANNELS) {
+        adc_accum += adc_buf[inc + channel - T0_AN + 1]; //CH1..CH3
+        if(channel == T0_AN) {
+            adc_accum += adc_buf[inc]; //CH0
         }
-        lcd_value_rounded = (int)(*(&lookup_temp_0+lookup_count)*10); //lower temperature bound
-
-        adc_high = (int)(*(&lookup_adc_0+lookup_count-1));
-        adc_low = (int)(*(&lookup_adc_0+lookup_count));
-        range = adc_high - adc_low;  //total range used for linterp
-
-        fraction = 10*(adc_accum - adc_low);
-        fraction = fraction / range;
-        fraction = 9 - fraction; // difference to add for linterp
-
-        lcd_value_rounded += fraction; //final interpolated data
-
-    } else {
-        /*T0_AN is the thermocouple input*/
-
-        /* According to the AD8495 Datasheet Rev. 3 (pg 14)
-         Tmj    = (Vout - Vref)/(5mV/C)     (Vref = GND = 0V)
-         *      = Vout*200
-         *    Vout = (adc_accum / 16) / 2^16 * 2.5
-         Tmj    = adc_accum / 16 * 2.5 / 2^16 * 200 (* 10 for lcd_val)
-         Tmj    = adc_accum * 312.5 / 2^16
-         *
-         */
-
-
-
-        //fraction =  (20000*(long)adc_accum)/((long)65535);
-        lcd_value_rounded = (3125*(long)adc_accum)>>16;
-        lcd_value_rounded = lcd_value_rounded / 10;
-        
-
-        Nop();
-        Nop();
-
-
     }
+    if(channel == T0_AN) {
+        return adc_accum << 1; //32 10-bit samples
+    }
+    return adc_accum << 2; /*! \return sum of the block (full scale = 2^16) */
+#else
+    adc_buf += channel*ADC_BLOCK_LENGTH;
+    for(inc = 0; inc < ADC_BLOCK_LENGTH; inc++) {
+        adc_accum += adc_buf[inc];
+    }
+    return adc_accum; /*! \return sum of the block (full scale = 2^16) */
+#endif
+}
 
+/*! \brief DMA1 ISR - sums a block of ADC samples and queues it
+ *
+ *	_DMA1Interrupt() is the DMA channel 1 interrupt service routine (ISR). The ADC scans T0_AN, T1_AN and T2_AN in hardware (CSCNA) and DMA1 scatters each result into a per-channel slot using peripheral indirect addressing, so one interrupt delivers a full block for all three probes and the mux is never reprogrammed here. DMA1 runs in continuous ping-pong mode: the ADC fills dma_adc_buf_a and dma_adc_buf_b alternately and the ISR sums the buffer that just completed while the DMA controller is already filling the other one.
+ *
+ *  Only the raw sums and a timestamp are captured here. They are pushed onto the ADC queue and converted to temperatures by temperature_task() in the main loop, which keeps this ISR short enough not to disturb the display ISR.
+ *
+ */
 
 
-    switch(ADC_SOURCE) {
-        case T0_AN:
-            T0_temp = lcd_value_rounded;
-            ADC_SOURCE = T1_AN;
-            break;
-        case T1_AN:
-            T1_temp = lcd_value_rounded;
-            ADC_SOURCE = T2_AN;
-            break;
-        case T2_AN:
-            T2_temp = lcd_value_rounded;
-            ADC_SOURCE = T0_AN;
-            break;
-    }
-        
-    
+void __attribute__((__interrupt__, auto_psv)) _DMA1Interrupt(void)
+{
+    unsigned int *adc_buf;
+    adcRecord record;
+    static unsigned char dma_adc_pong = 0; //0 = ping buffer (A) just completed, 1 = pong buffer (B)
+#if PROFILE_ISR
+    unsigned int profile_cycles;
 
+    PROFILE_START(profile_cycles);
+#endif
 
+    LED3 = 1;
+    LED4 = 1;
 
+    /* The DMA controller alternates between the two buffers starting with A,
+     * so a simple toggle tracks which one was just completed. */
+    if(dma_adc_pong == 0) {
+        adc_buf = dma_adc_buf_a;
+    } else {
+        adc_buf = dma_adc_buf_b;
+    }
+    dma_adc_pong ^= 1;
 
+    record.timestamp = timebase_read();
+    record.accum[T0_PROBE] = adc_block_sum(adc_buf, T0_AN);
+    record.accum[T1_PROBE] = adc_block_sum(adc_buf, T1_AN);
+    record.accum[T2_PROBE] = adc_block_sum(adc_buf, T2_AN);
+    adc_queue_push(&record); //a full queue is counted in adc_queue_overflows
 
     DMA1_FLAG = 0;
-
-
+#if PROFILE_ISR
+    PROFILE_END(profile_cycles, dma1_isr_max_cycles);
+#endif
 
     return;
 
 }
 
 
+#if LCD_REFRESH == LCD_REFRESH_ISR
 /*! \brief Interrupt Service Routine - updates LCD based on global variables
  *         
- *	_T2Interrupt() is the TIMER2 interrupt service routine (ISR). This interrupt occurs service routine is set to interrupt on the overflow of Timer2.  It updates the display based on the global variables "LCD_value", "LCD_dots", and "LCD_digit". It increments the digit variable.
+ *	_T2Interrupt() is the TIMER2 interrupt service routine (ISR). This interrupt occurs service routine is set to interrupt on the overflow of Timer2.  It shows the next digit of the display framebuffer built by lcd_set() from "LCD_value" and "LCD_dots".
  *  
  */
 	
@@ -215,14 +185,13 @@ void __attribute__((__interrupt__, auto_psv)) _DMA1Interrupt(void)
 void __attribute__((__interrupt__)) _T2Interrupt(void);
 void __attribute__((__interrupt__, auto_psv)) _T2Interrupt(void)
 {
-    static unsigned char LCD_digit = 0; //assuming this is done only once with a static variable
-    LCD_digit = (LCD_digit + 1) % 5;
-    lcd_display(LCD_digit, LCD_value, LCD_dots);
+    lcd_refresh();
  
     
     TMR2_FLAG = 0;
     return;
 }
+#endif
 
 #pragma code
 
@@ -244,23 +213,27 @@ int main (void) {
     unsigned char input_sensor = 2; 
     unsigned long sd_address = 0; ///current active sd card address
     unsigned char receive_buffer[512];
-    unsigned char transmit_buffer[2048];
-    unsigned char *transmit_ptr = &transmit_buffer[0];
     unsigned char *receive_ptr = &receive_buffer[0];
-    unsigned volatile long head = 0; ///write position of the buffer (where the next adc sample is stored in the circular buffer)
-    unsigned volatile long tail = 0; ///read position of the buffer (where the samples are read out of the buffer and sent to the sd card)
     timeData getTime;
+    unsigned long report_time = 0; ///timestamp of the last once-a-second report
+    unsigned char board_temp_age = 0; ///seconds since the board temperature was last read
 
 
 
     LCD_value = 0000;
     init();
+    timebase_init();
     lcd_init();
     timer2_init();
+    temperature_init();
     adc_init();
     i2c_init();
     uart_init();
     rtc_init();
+    temperature_set_board(rtc_read_temperature());
+
+    read_time(&getTime);
+    lcd_text(&getTime.timestring[0], 13, 1); //scroll the date and time once at power up
 
 
 
@@ -271,17 +244,16 @@ int main (void) {
     LCD_dots = 0b00000011;
     T2_LED = 1;
 
-    //HEATER1 = 1; //turn on heater 1
-    AD1CHS0bits.CH0SA = 3;
+    //HEATER_SET(HEATER1, 1); //turn on heater 1
 
 
     sd_address = SD_START_ADDRESS; /* the writing starts a few kb into the sd card to leave room for housekeeping */
     //__delay_ms(1000); //1 second delay to allow analog stages to stabilize
 
-    //sd_state = sd_init(); //returns 0 upon successful init, positive otherwise
-    
-    //clear the buf_pos so that we are pointing to the start of the buffer
-    head=tail=0;
+    sd_state = sd_init(); //returns 0 upon successful init, positive otherwise
+    if(sd_state == 0) {
+        logger_init(sd_address, &getTime); //resumes the log after a reset, without a card the log ring just counts overflows
+    }
 
     LED3 = 1; //inactive state
     LED4 = 0;
@@ -295,11 +267,32 @@ int main (void) {
    
 
    IFS0bits.U1TXIF=0;
+   report_time = timebase_read();
    while(1==1){
-       read_time(&getTime);
-       uart_write_string(&getTime.timestring[0], 13);
-
-       __delay_ms(1000);
+       temperature_task();
+       lcd_set(LCD_value, LCD_dots); //only rebuilds the framebuffer when they change
+       lcd_task();
+       logger_task();
+       sd_async_task(); //never waits on the card
+
+       if(timebase_read() - report_time >= TIMEBASE_TICKS_PER_SECOND) {
+           report_time += TIMEBASE_TICKS_PER_SECOND;
+           read_time(&getTime);
+           uart_write_string(&getTime.timestring[0], 13);
+           lcd_schedule(getTime.hours); //auto-dim overnight
+
+           //the DS3231 is the closest thing to the AD8495's cold junction
+           if(++board_temp_age >= RTC_TEMP_PERIOD) {
+               board_temp_age = 0;
+               temperature_set_board(rtc_read_temperature());
+           }
+#if PROFILE_ISR
+           uart_write_value((unsigned char *)"DMA1 ISR max cycles ", 20, dma1_isr_max_cycles);
+           uart_write_value((unsigned char *)"ADC queue overflows ", 20, adc_queue_overflows);
+           uart_write_value((unsigned char *)"Log ring overflows  ", 20, log_ring_overflows);
+           uart_write_value((unsigned char *)"Encode max cycles   ", 20, logger_encode_max_cycles);
+#endif
+       }
    }
 //        if(SW_SEL == 0) {
 //            input_sensor = (input_sensor + 4) % 3;
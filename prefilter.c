@@ -0,0 +1,109 @@
+/*! \file prefilter.c
+    \brief Outlier rejection for the ADC block sums
+
+    A single ESD spike on a probe cable shows up as one wild block sum.
+    prefilter_push() replaces each block sum with the median of the last
+    PROBE_MEDIAN_N blocks and then limits how far the result may move from
+    the previous output, so a spike never reaches the decimation filter or
+    the temperature conversions.
+
+    The median uses a fixed sorting network for the configured window (3, 7
+    or 13 compare/swaps for N = 3, 5 or 7) on a copy of the window, so the
+    cost is the same every block and there are no data dependent loops. It
+    runs from temperature_task(), not the ISR.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "prefilter.h"
+
+#if PROBE_MEDIAN_N != 0 && PROBE_MEDIAN_N != 3 && PROBE_MEDIAN_N != 5 && PROBE_MEDIAN_N != 7
+#error "PROBE_MEDIAN_N must be 0, 3, 5 or 7"
+#endif
+
+/* compare/swap so that a <= b */
+#define PREFILTER_SORT(a, b) { if((a) > (b)) { unsigned int t = (a); (a) = (b); (b) = t; } }
+
+/*! \brief Median of the window with a sorting network
+ *
+ * \return median of p[0..PROBE_MEDIAN_N-1] (p is reordered)
+ */
+
+static unsigned int prefilter_median(unsigned int *p) {
+#if PROBE_MEDIAN_N == 3
+    PREFILTER_SORT(p[0], p[1]); PREFILTER_SORT(p[1], p[2]); PREFILTER_SORT(p[0], p[1]);
+    return p[1];
+#elif PROBE_MEDIAN_N == 5
+    PREFILTER_SORT(p[0], p[1]); PREFILTER_SORT(p[3], p[4]); PREFILTER_SORT(p[0], p[3]);
+    PREFILTER_SORT(p[1], p[4]); PREFILTER_SORT(p[1], p[2]); PREFILTER_SORT(p[2], p[3]);
+    PREFILTER_SORT(p[1], p[2]);
+    return p[2];
+#elif PROBE_MEDIAN_N == 7
+    PREFILTER_SORT(p[0], p[5]); PREFILTER_SORT(p[0], p[3]); PREFILTER_SORT(p[1], p[6]);
+    PREFILTER_SORT(p[2], p[4]); PREFILTER_SORT(p[0], p[1]); PREFILTER_SORT(p[3], p[5]);
+    PREFILTER_SORT(p[2], p[6]); PREFILTER_SORT(p[2], p[3]); PREFILTER_SORT(p[3], p[6]);
+    PREFILTER_SORT(p[4], p[5]); PREFILTER_SORT(p[1], p[4]); PREFILTER_SORT(p[1], p[3]);
+    PREFILTER_SORT(p[3], p[4]);
+    return p[3];
+#else
+    return p[0];
+#endif
+}
+
+/*! \brief Sets up a channel's prefilter
+ *
+ *  slew_max is in block sum units per DMA block, 0 turns the limiter off.
+ */
+
+void prefilter_init(prefilterStage *pStage, unsigned int slew_max) {
+    pStage->next = 0;
+    pStage->primed = 0;
+    pStage->last = 0;
+    pStage->slew_max = slew_max;
+}
+
+/*! \brief Filters one DMA block sum
+ *
+ *  The first block sum fills the whole window so the filter starts at the
+ *  probe's reading instead of ramping up from zero.
+ *
+ * \return filtered block sum (same scale as adc_accum)
+ */
+
+unsigned int prefilter_push(prefilterStage *pStage, unsigned int adc_accum) {
+#if PROBE_MEDIAN_N != 0
+    unsigned int sorted[PROBE_MEDIAN_N];
+#endif
+    unsigned int value = adc_accum;
+    unsigned char k;
+
+    if(!pStage->primed) {
+        for(k = 0; k < PREFILTER_MEDIAN_MAX; k++) {
+            pStage->window[k] = adc_accum;
+        }
+        pStage->last = adc_accum;
+        pStage->primed = 1;
+    }
+
+#if PROBE_MEDIAN_N != 0
+    pStage->window[pStage->next] = adc_accum;
+    if(++pStage->next >= PROBE_MEDIAN_N) {
+        pStage->next = 0;
+    }
+    for(k = 0; k < PROBE_MEDIAN_N; k++) {
+        sorted[k] = pStage->window[k];
+    }
+    value = prefilter_median(sorted);
+#endif
+
+    if(pStage->slew_max != 0) {
+        if(value > pStage->last && value - pStage->last > pStage->slew_max) {
+            value = pStage->last + pStage->slew_max;
+        } else if(value < pStage->last && pStage->last - value > pStage->slew_max) {
+            value = pStage->last - pStage->slew_max;
+        }
+    }
+    pStage->last = value;
+
+    return value;
+}
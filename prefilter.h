@@ -0,0 +1,20 @@
+
+#ifndef INC_PREFILTER_H
+#define INC_PREFILTER_H
+
+#define PREFILTER_MEDIAN_MAX 7 ///longest supported median window
+
+/* One channel's outlier filter: running median of the last PROBE_MEDIAN_N
+ * block sums followed by a slew rate limiter. */
+typedef struct prefilterStage {
+    unsigned int window[PREFILTER_MEDIAN_MAX]; //last block sums, oldest overwritten first
+    unsigned char next; //slot the next block sum goes into
+    unsigned char primed; //1 once window[] and last hold real samples
+    unsigned int last; //previous output
+    unsigned int slew_max; //largest change allowed per block (0 = no limit)
+}prefilterStage;
+
+void prefilter_init(prefilterStage *pStage, unsigned int slew_max);
+unsigned int prefilter_push(prefilterStage *pStage, unsigned int adc_accum);
+
+#endif
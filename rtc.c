@@ -164,6 +164,26 @@ unsigned char write_time(timeData *pTimeData) {
 
 
 
+/*! \brief Reads the DS3231's on-die temperature sensor
+ *
+ *  Both temperature registers are read in one burst so the MSB and LSB
+ *  come from the same conversion. The DS3231 only updates them every 64
+ *  seconds, so there is no point calling this more often (RTC_TEMP_PERIOD).
+ *
+ * \return board temperature in hundredths of a degree C (0.25 C resolution)
+ */
+
+int rtc_read_temperature(void) {
+    unsigned char i2c_buf[2];
+
+    i2c_read_burst(RTC_ADDRESS, RTC_TEMP_MSB, &i2c_buf[0], 2);
+
+    //MSB is whole degrees (two's complement), bits 7:6 of LSB are quarters
+    return (((int)(signed char)i2c_buf[0] << 2) | (i2c_buf[1] >> 6)) * 25;
+}
+
+
+
 /* Found this at: http://stackoverflow.com/questions/3694100/converting-to-ascii-in-c .
  Its an efficient way to implement itoa() on an embedded system.
 
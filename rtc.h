@@ -20,5 +20,6 @@ unsigned char rtc_init();
 char makedigit (unsigned char number, unsigned char base);
 unsigned char load_reset_time(timeData *pTimeData);
 unsigned char write_time(timeData *pTimeData);
+int rtc_read_temperature(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+/*! \file sd_async.c
+    \brief Non-blocking SD card block writer
+
+    Writes one block at a time without ever waiting on the card. A block is
+    handed over with sd_async_submit() and sd_async_task(), called from the
+    main loop, moves it through COMMAND -> DATA -> TOKEN -> BUSY -> DONE. Each
+    call does a bounded amount of SPI work (at most SD_POLLS_PER_TASK polled
+    bytes) and then returns, so a card that takes hundreds of milliseconds to
+    program a block never stalls sampling, the display or the UART. Every
+    state that waits on the card has a timebase_read() deadline.
+
+    Consecutive addresses share one CMD25 multi-block session. A block for any
+    other address (or sd_async_close()) ends the session with the stop tran
+    token first. The card stays selected while a session is open, so nothing
+    else may use SPI1 until sd_async_close() has finished.
+
+    Deselecting the card does not end a session: the card stays in its
+    receive data state and ignores the next CMD25. A block that fails inside
+    a session therefore still ends it with the stop tran token (after the
+    card stops signalling busy) before the error is reported.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "spi_sd.h"
+#include "timebase.h"
+#include "sd_async.h"
+
+static unsigned char sd_state = SD_ASYNC_IDLE;
+static unsigned char sd_result = 0; ///sd_async_complete() return value
+static unsigned char sd_session = 0; ///1 while a CMD25 session is open
+static unsigned char sd_stop = 0; ///1 = stop tran token not sent yet
+static unsigned char sd_abort = 0; ///1 = ending the session after an error held in sd_result
+static unsigned char sd_start = 0; ///1 = a block is waiting for its session
+static unsigned long sd_addr = 0; ///block being written
+static unsigned long sd_next_addr = 0; ///address that continues the open session
+static unsigned char *sd_block = 0;
+static unsigned long sd_deadline = 0; ///timebase_read() limit for the current state
+
+/*! \brief Moves to a state that waits on the card
+ */
+
+static void sd_enter(unsigned char state, unsigned long timeout) {
+    sd_state = state;
+    sd_deadline = timebase_read() + timeout;
+}
+
+/*! \brief Checks the current state's deadline
+ */
+
+static unsigned char sd_expired(void) {
+    return (long)(timebase_read() - sd_deadline) >= 0; /*! \return 1 = deadline passed */
+}
+
+/*! \brief Ends the write with an error
+ *
+ *  An open session is first ended through SD_ASYNC_STOP, which reports the
+ *  error once the card has taken the stop tran token. Then the card is
+ *  deselected, so the next block starts over with a fresh CMD25.
+ */
+
+static void sd_fail(unsigned char result) {
+    sd_start = 0;
+    if(sd_session && !sd_abort) {
+        sd_result = result;
+        sd_abort = 1;
+        sd_stop = 1;
+        sd_enter(SD_ASYNC_STOP, SD_WRITE_TIMEOUT_TICKS);
+        return;
+    }
+    CS1_PIN = 1;
+    SPI1Write(0xFF);
+    sd_session = 0;
+    if(!sd_abort) sd_result = result; //a failed stop keeps the error that started it
+    sd_abort = 0;
+    sd_state = SD_ASYNC_ERROR;
+}
+
+/*! \brief Sends CMD25 for the submitted block
+ */
+
+static void sd_command(void) {
+    CS1_PIN = 0;
+    SPI1Write(0xFF);
+    SPI1Write(0b01011001); //CMD25
+    SPI1Write((sd_addr & 0xFF000000) >> 24);
+    SPI1Write((sd_addr & 0x00FF0000) >> 16);
+    SPI1Write((sd_addr & 0x0000FF00) >> 8);
+    SPI1Write((sd_addr & 0x000000FF));
+    SPI1Write(0xFF);
+    sd_enter(SD_ASYNC_COMMAND, SD_CMD_TIMEOUT_TICKS);
+}
+
+/*! \brief Starts writing a block
+ *
+ *  The block is not copied until the DATA state, so it must stay untouched
+ *  until sd_async_poll() reports SD_ASYNC_DONE or SD_ASYNC_ERROR. A block
+ *  built in SD_DMABuffer() is sent without a copy.
+ */
+
+unsigned char sd_async_submit(unsigned long addr, unsigned char *block) {
+    if(sd_state != SD_ASYNC_IDLE)
+        return 1; /*! \return 1 = busy, complete the previous block first */
+
+    sd_addr = addr;
+    sd_block = block;
+    sd_result = 0;
+    if(sd_session && addr == sd_next_addr) {
+        sd_state = SD_ASYNC_DATA; //continue the open CMD25 session
+        SD_StartDMA(0xFC, sd_block);
+    } else if(sd_session) {
+        sd_start = 1;
+        sd_stop = 1;
+        sd_enter(SD_ASYNC_STOP, SD_WRITE_TIMEOUT_TICKS);
+    } else {
+        sd_command();
+    }
+    return 0; /*! \return 0 = accepted */
+}
+
+/*! \brief Ends the open multi-block session
+ *
+ *  The stop tran token goes out on a later sd_async_task() once the card is
+ *  idle. Call this before powering the card down or using SPI1 for anything
+ *  else, then wait for sd_async_poll() to return SD_ASYNC_IDLE.
+ */
+
+void sd_async_close(void) {
+    if(sd_session && sd_state == SD_ASYNC_IDLE) {
+        sd_stop = 1;
+        sd_enter(SD_ASYNC_STOP, SD_WRITE_TIMEOUT_TICKS);
+    }
+}
+
+/*! \brief Advances the write (call from the main loop)
+ */
+
+void sd_async_task(void) {
+    unsigned char status;
+    unsigned char inc;
+
+    switch(sd_state) {
+    case SD_ASYNC_STOP:
+        for(inc = 0; inc < SD_POLLS_PER_TASK; inc++) {
+            if(SPI1Read() == 0x00) {
+                continue; //busy
+            }
+            if(sd_stop) { //after an error the card may still be programming
+                sd_stop = 0;
+                sd_session = 0; //the token ends the session, only its busy signal is left
+                SPI1Write(0b11111101); //stop tran token
+                SPI1Write(0xFF); //the card starts its busy signal one byte later
+                sd_enter(SD_ASYNC_STOP, SD_WRITE_TIMEOUT_TICKS);
+                return;
+            }
+            CS1_PIN = 1; //deselect sd card
+            SPI1Write(0xFF); //clock
+            if(sd_abort) {
+                sd_abort = 0;
+                sd_state = SD_ASYNC_ERROR;
+            } else if(sd_start) {
+                sd_start = 0;
+                sd_command();
+            } else {
+                sd_state = SD_ASYNC_IDLE;
+            }
+            return;
+        }
+        if(sd_expired()) sd_fail(5);
+        return;
+
+    case SD_ASYNC_COMMAND:
+        for(inc = 0; inc < SD_POLLS_PER_TASK; inc++) {
+            status = SPI1Read();
+            if(status == 0x00) {
+                sd_session = 1;
+                sd_state = SD_ASYNC_DATA;
+                SD_StartDMA(0xFC, sd_block);
+                return;
+            }
+            if(status != 0xFF) {
+                sd_fail(2);
+                return;
+            }
+        }
+        if(sd_expired()) {
+            sd_session = 1; //the card may have taken CMD25 with its R1 lost, and a stray stop tran token is harmless
+            sd_fail(2);
+        }
+        return;
+
+    case SD_ASYNC_DATA:
+        if(!SD_DMABusy()) {
+            sd_enter(SD_ASYNC_TOKEN, SD_CMD_TIMEOUT_TICKS);
+        }
+        return;
+
+    case SD_ASYNC_TOKEN:
+        for(inc = 0; inc < SD_POLLS_PER_TASK; inc++) {
+            status = SPI1Read();
+            if((status & 0x11) == 0x01) {
+                if((status & 0x1F) != 0x05) {
+                    sd_fail(3);
+                    return;
+                }
+                sd_enter(SD_ASYNC_BUSY, SD_WRITE_TIMEOUT_TICKS);
+                return;
+            }
+        }
+        if(sd_expired()) sd_fail(2);
+        return;
+
+    case SD_ASYNC_BUSY:
+        for(inc = 0; inc < SD_POLLS_PER_TASK; inc++) {
+            if(SPI1Read() != 0x00) {
+                sd_next_addr = sd_addr + 1; //SDHC addresses count blocks
+                sd_state = SD_ASYNC_DONE;
+                return;
+            }
+        }
+        if(sd_expired()) sd_fail(4);
+        return;
+    }
+}
+
+/*! \brief Returns the writer's state (one of SD_ASYNC_IDLE..SD_ASYNC_ERROR)
+ */
+
+unsigned char sd_async_poll(void) {
+    return sd_state;
+}
+
+/*! \brief Collects the result of the submitted block
+ *
+ *  Frees the writer for the next sd_async_submit().
+ */
+
+unsigned char sd_async_complete(void) {
+    if(sd_state != SD_ASYNC_DONE && sd_state != SD_ASYNC_ERROR)
+        return 1; /*! \return 1 = still writing */
+
+    sd_state = SD_ASYNC_IDLE;
+    return sd_result;
+    /*! \return 0 = block written
+     *  \return 2 = CMD25 refused, or no R1 or data response in time
+     *  \return 3 = block rejected (CRC or write error)
+     *  \return 4 = timeout waiting for the card to program the block
+     *  \return 5 = timeout ending the previous session */
+}
@@ -0,0 +1,23 @@
+
+#ifndef INC_SD_ASYNC_H
+#define INC_SD_ASYNC_H
+
+/** @defgroup SD_ASYNC_STATES sd_async_poll() states
+ * @{ */
+#define SD_ASYNC_IDLE       0 ///nothing submitted
+#define SD_ASYNC_STOP       1 ///ending the previous CMD25 session (stop tran token, then busy)
+#define SD_ASYNC_COMMAND    2 ///CMD25 sent, waiting for R1
+#define SD_ASYNC_DATA       3 ///DMA streaming data token, block and CRC
+#define SD_ASYNC_TOKEN      4 ///waiting for the data response token
+#define SD_ASYNC_BUSY       5 ///card holding DO low while it programs the block
+#define SD_ASYNC_DONE       6 ///block written, waiting for sd_async_complete()
+#define SD_ASYNC_ERROR      7 ///write failed, waiting for sd_async_complete()
+/** @} */
+
+unsigned char sd_async_submit(unsigned long addr, unsigned char *block);
+void sd_async_close(void);
+void sd_async_task(void);
+unsigned char sd_async_poll(void);
+unsigned char sd_async_complete(void);
+
+#endif
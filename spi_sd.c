@@ -9,7 +9,13 @@
 #include "defs.h"
 #include "globals.h"
 #include "spi_sd.h"
+#include "sram.h"
 #include <libpic30.h> //for delays
+#include <string.h>
+
+static volatile unsigned char sd_dma_busy = 0; ///1 while DMA2 is sending dma_sd_block
+static unsigned char sd_dma_pending = 0; ///1 until SD_WriteDMAEnd() reads the data response
+static unsigned char sd_dma_single = 0; ///1 if the block was started by SD_WriteBlockDMA() (CMD24)
 
 /*! \brief Hangs until SD card is ready
  *         
@@ -63,9 +69,8 @@ unsigned char SPI1Read(void) {
  */
 
 void SPI1Write(unsigned char data) {
-	unsigned char temp; 
 	SPI1STATbits.SPIROV = 0;        // clear out any rx overflow 
-  	temp = SPI1BUF;                 // dummy read to clear flag 
+  	(void)SPI1BUF;                  // dummy read to clear flag 
   	while (SPI1STATbits.SPITBF);    // wait for TX buffer to dump 
   	SPI1BUF = data; 
   	while(!SPI1STATbits.SPIRBF); 
@@ -88,6 +93,8 @@ unsigned char sd_init() {
     SCK1_PIN_DIR = 0; //SCK1 as output
     SCK1_PIN = 1; //default on idle state
 
+    IPC1bits.DMA0IP = 3; //sd block transfer complete, below the ADC and display
+    DMA0_FLAG = 0;
 
 
     //The SPI1 module is initially configured with a clock speed of ~300KHz
@@ -454,7 +461,7 @@ unsigned char SD_WriteMultiBlockInit (unsigned long addr) {
 
 /*! \brief Writes a block in a multi-block write
  *
- *	Writes a single block. The write must have been initialized using SD_WriteMultiBlock(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
+ *	Writes the block at staging memory address (addr). The write must have been initialized using SD_WriteMultiBlockInit(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
  *
  * \sa SD_WriteMultiBlockInit(), SD_WriteMultiBlockEnd()
  *
@@ -468,10 +475,9 @@ unsigned char SD_WriteMultiBlock(unsigned long addr) {
     CS1_PIN = 0; //enable SD card
     SPI1Write(0xFC); //send data token
 
+    set_memory_address(addr); //memory_read() advances the address itself
     for(inc = 0; inc < BLOCK_SIZE; inc++) {
-		//FIX THIS!!!!set_memory_address(addr++); // write the buffer pointer to memory address pins
-		//FIX THIS!!!!data = memory_read();
-		//FIX THIS!!!!SPI1Write(data); //Write the data to the sd card
+		SPI1Write(memory_read()); //Write the data to the sd card
     }
 
     SPI1Write(0xFF); //send CRC
@@ -499,54 +505,147 @@ unsigned char SD_WriteMultiBlock(unsigned long addr) {
 }	
 
 
+/*! \brief Starts streaming dma_sd_block to the card
+ *
+ *  DMA2 moves dma_sd_block into SPI1BUF one byte per SPI1 transfer and DMA0
+ *  moves each received byte into dma_sd_discard, so the receiver never
+ *  overflows. Both channels are one-shot: DMA0 completes when the last CRC
+ *  byte has been clocked out and its interrupt calls SD_DMAComplete().
+ */
+
+void SD_StartDMA(unsigned char token, unsigned char *send_ptr) {
+    if(send_ptr != &dma_sd_block[1]) {
+        memcpy(&dma_sd_block[1], send_ptr, BLOCK_SIZE); //DMA can only read DMA RAM
+    }
+    dma_sd_block[0] = token;
+    dma_sd_block[BLOCK_SIZE+1] = 0xFF; //CRC (ignored in SPI mode)
+    dma_sd_block[BLOCK_SIZE+2] = 0xFF;
+
+    SPI1STATbits.SPIROV = 0;
+    (void)SPI1BUF; //dummy read so DMA0 starts on the first byte of the block
+    sd_dma_busy = 1;
+
+    DMA0CONbits.CHEN = 0;
+    DMA0CONbits.SIZE = 1; //byte transfers
+    DMA0CONbits.DIR = 0; //peripheral to RAM
+    DMA0CONbits.AMODE = 0b01; //register indirect without post-increment
+    DMA0CONbits.MODE = 0b01; //one-shot, ping-pong disabled
+    DMA0REQ = SD_DMA_IRQ;
+    DMA0PAD = (int)&SPI1BUF;
+    DMA0STA = __builtin_dmaoffset(&dma_sd_discard);
+    DMA0CNT = SD_DMA_LENGTH - 1;
+
+    DMA2CONbits.CHEN = 0;
+    DMA2CONbits.SIZE = 1; //byte transfers
+    DMA2CONbits.DIR = 1; //RAM to peripheral
+    DMA2CONbits.AMODE = 0b00; //register indirect with post-increment
+    DMA2CONbits.MODE = 0b01; //one-shot, ping-pong disabled
+    DMA2REQ = SD_DMA_IRQ;
+    DMA2PAD = (int)&SPI1BUF;
+    DMA2STA = __builtin_dmaoffset(dma_sd_block);
+    DMA2CNT = SD_DMA_LENGTH - 1;
+
+    DMA0_FLAG = 0;
+    DMA0_IE = 1;
+    DMA0CONbits.CHEN = 1;
+    DMA2CONbits.CHEN = 1;
+    DMA2REQbits.FORCE = 1; //SPI1 is idle, so write the first byte by hand
+}
+
+/*! \brief Marks the DMA transfer as finished
+ *
+ *  Called from _DMA0Interrupt() once the last byte has left SPI1.
+ */
+
+void SD_DMAComplete(void) {
+    sd_dma_busy = 0;
+}
+
+/*! \brief Returns the block buffer used by the DMA writes
+ *
+ *  A block assembled in place here is sent without the copy that
+ *  SD_WriteMultiBlockDMA() otherwise makes. Do not touch it while
+ *  SD_DMABusy() is set.
+ */
+
+unsigned char *SD_DMABuffer(void) {
+    return &dma_sd_block[1]; /*! \return pointer to BLOCK_SIZE bytes of DMA RAM */
+}
+
+/*! \brief Checks for a DMA block transfer in progress
+ */
+
+unsigned char SD_DMABusy(void) {
+    return sd_dma_busy; /*! \return 1 = a block is still being clocked out */
+}
+
 /*! \brief Writes a block in a multi-block write using the DMA module
  *
- *	Writes a single block. The write must have been initialized using SD_WriteMultiBlock(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
+ *	Starts sending a single block and returns while DMA0/DMA2 clock it out; the CPU is free until SD_WriteDMAEnd() collects the card's data response. The write must have been initialized using SD_WriteMultiBlockInit(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
  *
- * \sa SD_WriteMultiBlockInit(), SD_WriteMultiBlockEnd()
+ *  send_ptr is copied into DMA RAM unless it is SD_DMABuffer().
+ *
+ * \sa SD_WriteMultiBlockInit(), SD_WriteDMAEnd(), SD_WriteMultiBlockEnd()
  *
  */
 
 unsigned char SD_WriteMultiBlockDMA(unsigned char *send_ptr) {
-	/*This section of code only works if a multi-block write is already 
-      in progress. Start a multi-block write with SD_WriteMultiBlockInit()*/
-    /*
-    unsigned int inc = 0; 
-	unsigned char status = 0;
-	
-	//setup DMA
-	DMACON1 = 0b00100100;
-	DMACON2 = 0b00000000; 
-	DMABCH = ((char)(511 >> 8));
-	DMABCL = 511 & 0xFF; 
-	TXADDRH = ((char)((unsigned int)send_ptr >> 8)) ;
-	TXADDRL = (unsigned int)send_ptr & 0xFF; 
-	Nop();
-	
-	
-	SPI1Write(0xFC); //send data token
-	
-	//use DMA to write data
-	PIR3bits.SSP1IF = 0;
-	DMACON1bits.DMAEN = 1; 
-	Nop();
-	Nop();
-	while(PIR3bits.SSP1IF == 0); //TIMEOUT CHECK HERE
-	
-	SPI1Write(0xFF); //write CRC
-	SPI1Write(0xFF);
-	
-	do {
-		status = SPI1Read();
-	} while(status & 0x1F != 0x05); //wait for data token
-		
-	inc = 0;
-	while(SPI1Read() == 0x00) { //wait for busy signal
-		inc++; //TIMEOUT CHECK HERE
-	}
-         */
-	return 0; 
-}	
+    if(sd_dma_busy || sd_dma_pending)
+        return 1; /*! \return 1 = previous block not finished with SD_WriteDMAEnd() */
+
+    CS1_PIN = 0; //enable SD card
+    sd_dma_single = 0;
+    sd_dma_pending = 1;
+    SD_StartDMA(0xFC, send_ptr);
+    return 0; /*! \return 0 = block is being sent */
+}
+
+/*! \brief Finishes a block started by SD_WriteMultiBlockDMA() or SD_WriteBlockDMA()
+ *
+ *	Once the DMA transfer is complete this reads the data response token and waits out the card's busy signal for at most WRITE_BUSY_TIMEOUT reads. A single block write (CMD24) also deselects the card, and so does a busy timeout.
+ *
+ */
+
+unsigned char SD_WriteDMAEnd(void) {
+    unsigned int inc = 0;
+    unsigned long busy = 0;
+    unsigned char status = 0;
+
+    if(sd_dma_busy)
+        return 1; /*! \return 1 = block is still being clocked out, call again later */
+    if(!sd_dma_pending)
+        return 0;
+    sd_dma_pending = 0;
+
+    /*After receiving the data the card will return a data token.
+     * The data token format is:
+         0bXXX00101 = successful write
+         0bXXX01011 = CRC error
+         0bXXX01101 = write error*/
+
+    do {
+        if(inc++ > MULTI_TOKEN_TIMEOUT)
+            return 2; /*! \return 2 = Error: no data token response*/
+        status = SPI1Read();
+    } while((status & 0x11) != 0x01); //wait for data token
+
+    if((status & 0x1F) != 0x05)
+        return 3; /*! \return 3 = Error: block rejected (CRC or write error) */
+
+    while(SPI1Read() == 0x00) { //the sd card will hold the data line low until the block is written
+        if(busy++ > WRITE_BUSY_TIMEOUT) {
+            CS1_PIN = 1;
+            SPI1Write(0xFF);
+            return 4; /*! \return 4 = Error: card still busy after WRITE_BUSY_TIMEOUT reads */
+        }
+    }
+
+    if(sd_dma_single) {
+        CS1_PIN = 1;
+        SPI1Write(0xFF);
+    }
+    return 0; /*! \return 0 = block written */
+}
 
 /*! \brief Ends a multi-block write
  *
@@ -574,7 +673,7 @@ unsigned char SD_WriteMultiBlockEnd () {
 
 /*! \brief Writes a single block without DMA
  *
- *  Writes a block at address (addr). THIS FUNCTION DOES NOT CURRENTLY WORK!
+ *  Writes a block of 512 bytes (data) at address (addr) and waits for the card to program it.
  *
  * \sa SD_WriteBlockDMA()
  *
@@ -611,8 +710,7 @@ unsigned char SD_WriteBlock(unsigned long addr, unsigned char *data) {//, unsign
     SPI1Write(0xFE); //send data token
 	
     for(inc = 0; inc < BLOCK_SIZE; inc++) {
-	//SPI1Write(*data);
-        SPI1Write(0xF0);
+	SPI1Write(*data);
         data++;
     }
     SPI1Write(0xFF); //write CRC
@@ -654,70 +752,53 @@ unsigned char SD_WriteBlock(unsigned long addr, unsigned char *data) {//, unsign
 	
 /*! \brief Writes a single block with DMA
  *
- * Writes a block of 512 bytes (starting at the location pointed to by send_ptr) to the SD Card. Uses DMA to increase the transfer speed. CMD24
+ * Sends CMD24 and starts streaming a block of 512 bytes (starting at the location pointed to by send_ptr) to the SD Card with DMA. Finish the write with SD_WriteDMAEnd().
  *
- * THIS FUNCTION IS NOT CURRENTLY IMPLEMENTED. IT WILL RETURN 0!
+ * \sa SD_WriteMultiBlockDMA(), SD_WriteDMAEnd()
  *
  */
 
-
-unsigned char SD_WriteBlockDMA(unsigned long addr, unsigned char *send_ptr) {//, unsigned char *buf) {
-    
-    /*
-    unsigned int inc;
+unsigned char SD_WriteBlockDMA(unsigned long addr, unsigned char *send_ptr) {
     unsigned char status;
-    unsigned char CMD24_WRITE_SINGLE_BLOCK[] = {24,0x00,0x00,0x00,0x00,0xFF};
-    CMD24_WRITE_SINGLE_BLOCK[1] = ((addr & 0xFF000000) >> 24);
-    CMD24_WRITE_SINGLE_BLOCK[2] = ((addr & 0x00FF0000) >> 16);
-    CMD24_WRITE_SINGLE_BLOCK[3] = ((addr & 0x0000FF00) >> 8);
-    CMD24_WRITE_SINGLE_BLOCK[4] = ((addr & 0x000000FF));
-
-    CS1_PIN = 0; //enabled SD card
-	
-	//setup DMA
-    DMACON1 = 0b00100100;
-    DMACON2 = 0b00000000;
-    DMABCH = ((char)(511 >> 8));
-    DMABCL = 511 & 0xFF;
-    TXADDRH = ((char)((unsigned int)send_ptr >> 8)) ;
-    TXADDRL = (unsigned int)send_ptr & 0xFF;
-    Nop();
-    // Send the write command
-    status = SD_WriteCommand(CMD24_WRITE_SINGLE_BLOCK);
-    if(status != 0) {
-        return 1; //error
-	}
-	SPI1Write(0xFE); //send data token
-	
-	//use DMA to write data
-	PIR3bits.SSP1IF = 0;
-	DMACON1bits.DMAEN = 1; 
-	Nop();
-	Nop();
-	while(PIR3bits.SSP1IF == 0); //TIMEOUT CHECK HERE
-	
-	SPI1Write(0xFF); //write CRC
-	SPI1Write(0xFF);
-	
-	
-	do {
-		status = SPI1Read();
-	} while(status & 0x1F != 0x05); //wait for data token
-		
-	inc = 0;
-	while(SPI1Read() == 0x00) {
-		inc++;
-	}	
-	
-		
-		
-	CS1_PIN = 1; 
-	SPI1Write(0xFF);
-	
-	*/
-	return 0;
-}				
-	
+    unsigned char i = 0;
+
+    if(sd_dma_busy || sd_dma_pending)
+        return 3; /*! \return 3 = previous block not finished with SD_WriteDMAEnd() */
+
+    CS1_PIN = 1;
+    SPI1Write(0xFF);
+    CS1_PIN = 0;
+    SPI1Write(0xFF);
+
+    if(sd_card_ready() != 1) return 1; /*! \return 1 = sd card is not ready */
+
+    /* Write CMD24 */
+    SPI1Write(0x40 | 24);
+    SPI1Write((addr & 0xFF000000) >> 24);
+    SPI1Write((addr & 0x00FF0000) >> 16);
+    SPI1Write((addr & 0x0000FF00) >> 8);
+    SPI1Write((addr & 0x000000FF));
+    SPI1Write(0xFF);
+
+    do {
+        status = SPI1Read();
+        if(i++ > 20) {
+            CS1_PIN = 1;
+            return 2; /*! \return 2 = CMD24 response timeout */
+        }
+    } while (status == 0xFF); //wait for R1 response
+
+    if(status != 0x00) {
+        CS1_PIN = 1;
+        return 4; /*! \return 4 = CMD24 rejected (R1 error bits set) */
+    }
+
+    sd_dma_single = 1;
+    sd_dma_pending = 1;
+    SD_StartDMA(0xFE, send_ptr);
+    return 0; /*! \return 0 = block is being sent */
+}
+
 /*! \brief Reads the status register of the SD Card
  *
  *  Reads the status register of the SD Card and loads it into a 512byte array.
@@ -805,53 +886,141 @@ unsigned char SD_ReadStatus(unsigned char *buf) {
  */
 
 unsigned char SD_ReadBlock(unsigned long addr, unsigned char *buf) {
-//    unsigned int i;
-//    unsigned char status;
-//    unsigned char CMD17_READ_SINGLE_BLOCK[] = {17,0x00,0x00,0x00,0x00,0xFF};
-//
-//
-//    CMD17_READ_SINGLE_BLOCK[1] = ((addr & 0xFF000000) >> 24);
-//    CMD17_READ_SINGLE_BLOCK[2] = ((addr & 0x00FF0000) >> 16);
-//    CMD17_READ_SINGLE_BLOCK[3] = ((addr & 0x0000FF00) >> 8);
-//    CMD17_READ_SINGLE_BLOCK[4] = ((addr & 0x000000FF));
-//
-//    CS1_PIN = 0; //enable SD card
-//
-//    // Send the read command
-//    status = SD_WriteCommand(CMD17_READ_SINGLE_BLOCK);
-//    if(status != 0)
-//        return 1;  /* \return 1 = Error: invalid response from CMD17*/
-//
-//
-//    // Now wait for the "Start Block" token	(0xFE)
-//    // (see SanDisk SD Card Product Manual v1.9 section 5.2.4. Data Tokens)
-//    i = 0;
-//    do {
-//        if(i++ > START_BLOCK_TIMEOUT)
-//            return 2; /* \return 2 = Error: no start block response
-//                       */
-//		status = SPI1Read();
-//    } while(status != 0xFE);
-//
-//    // Read off all the bytes in the block
-//    for(i = 0; i < BLOCK_SIZE; ++i) {
-//	status = SPI1Read();
-//	*buf = status;
-//	buf++;
-//    }
-//
-//    // Read CRC bytes
-//    status = SPI1Read();
-//    status = SPI1Read();
-//
-//    CS1_PIN = 1; //unselect SD Card
-//
-//    // Following a read transaction, the SD Card needs 8 clocks after the end
-//    // bit of the last data block to finish up its work.
-//    // (from SanDisk SD Card Product Manual v1.9 section 5.1.8)
-//    SPI1Write(0xFF);
-//
-    return 0; /* \return 0 = Successfully read block from sd card. Data is stored in the receive buffer*/
+    unsigned int i;
+    unsigned char status;
+
+    CS1_PIN = 1;
+    SPI1Write(0xFF);
+    CS1_PIN = 0; //enable SD card
+    SPI1Write(0xFF);
+
+    if(sd_card_ready() != 1) {
+        CS1_PIN = 1;
+        return 3; /*! \return 3 = Error: sd card not ready */
+    }
+
+    /* Write CMD17 */
+    SPI1Write(0x40 | 17);
+    SPI1Write((addr & 0xFF000000) >> 24);
+    SPI1Write((addr & 0x00FF0000) >> 16);
+    SPI1Write((addr & 0x0000FF00) >> 8);
+    SPI1Write((addr & 0x000000FF));
+    SPI1Write(0xFF);
+
+    i = 0;
+    do {
+        status = SPI1Read();
+        if(i++ > 20) {
+            CS1_PIN = 1;
+            return 1; /*! \return 1 = Error: invalid response from CMD17 */
+        }
+    } while (status == 0xFF); //wait for R1 response
+
+    if(status != 0x00) {
+        CS1_PIN = 1;
+        return 1;
+    }
+
+    // Now wait for the "Start Block" token	(0xFE)
+    // (see SanDisk SD Card Product Manual v1.9 section 5.2.4. Data Tokens)
+    i = 0;
+    do {
+        if(i++ > START_BLOCK_TIMEOUT) {
+            CS1_PIN = 1;
+            return 2; /*! \return 2 = Error: no start block response */
+        }
+	status = SPI1Read();
+    } while(status != 0xFE);
+
+    // Read off all the bytes in the block
+    for(i = 0; i < BLOCK_SIZE; ++i) {
+	*buf = SPI1Read();
+	buf++;
+    }
+
+    // Read CRC bytes
+    status = SPI1Read();
+    status = SPI1Read();
+
+    CS1_PIN = 1; //unselect SD Card
+
+    // Following a read transaction, the SD Card needs 8 clocks after the end
+    // bit of the last data block to finish up its work.
+    // (from SanDisk SD Card Product Manual v1.9 section 5.1.8)
+    SPI1Write(0xFF);
+
+    return 0; /*! \return 0 = Successfully read block from sd card. Data is stored in the receive buffer*/
+}
+
+/*! \brief Reads the size of the SD card
+ *
+ *  Sends CMD9 and reads the 16 byte CSD register. Only the version 2.0 CSD of SDHC/SDXC cards is understood, which is the only
+ *  kind sd_init() brings up: the card holds (C_SIZE + 1) * 1024 blocks of 512 bytes.
+ *
+ */
+
+unsigned char SD_ReadCapacity(unsigned long *pBlocks) {
+    unsigned char csd[16];
+    unsigned int i;
+    unsigned char status;
+
+    CS1_PIN = 1;
+    SPI1Write(0xFF);
+    CS1_PIN = 0; //enable SD card
+    SPI1Write(0xFF);
+
+    if(sd_card_ready() != 1) {
+        CS1_PIN = 1;
+        return 3; /*! \return 3 = Error: sd card not ready */
+    }
+
+    /* Write CMD9 */
+    SPI1Write(0x40 | 9);
+    SPI1Write(0x00);
+    SPI1Write(0x00);
+    SPI1Write(0x00);
+    SPI1Write(0x00);
+    SPI1Write(0xFF);
+
+    i = 0;
+    do {
+        status = SPI1Read();
+        if(i++ > 20) {
+            CS1_PIN = 1;
+            return 1; /*! \return 1 = Error: invalid response from CMD9 */
+        }
+    } while (status == 0xFF); //wait for R1 response
+
+    if(status != 0x00) {
+        CS1_PIN = 1;
+        return 1;
+    }
+
+    i = 0;
+    do {
+        if(i++ > START_BLOCK_TIMEOUT) {
+            CS1_PIN = 1;
+            return 2; /*! \return 2 = Error: no start block response */
+        }
+        status = SPI1Read();
+    } while(status != 0xFE);
+
+    for(i = 0; i < sizeof(csd); ++i) {
+        csd[i] = SPI1Read();
+    }
+
+    // Read CRC bytes
+    SPI1Read();
+    SPI1Read();
+
+    CS1_PIN = 1; //unselect SD Card
+    SPI1Write(0xFF);
+
+    if((csd[0] >> 6) != 1)
+        return 4; /*! \return 4 = Error: not a version 2.0 (SDHC/SDXC) CSD */
+
+    *pBlocks = ((((unsigned long)(csd[7] & 0x3F) << 16) | ((unsigned int)csd[8] << 8) | csd[9]) + 1) << 10;
+    return 0; /*! \return 0 = *pBlocks holds the number of 512 byte blocks on the card */
 }
 
 /*! \brief Sets the number of blocks to be pre-erased on the SD Card
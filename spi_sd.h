@@ -9,11 +9,18 @@ unsigned char sd_init(void);
 unsigned char SPI_RW(unsigned char data);
 unsigned char SD_WriteCommand(unsigned char* cmd);
 unsigned char SD_ReadBlock(unsigned long addr, unsigned char *buf);
+unsigned char SD_ReadCapacity(unsigned long *pBlocks);
 unsigned char SD_WriteBlock(unsigned long addr, unsigned char *data);
 unsigned char SD_WriteMultiBlock(unsigned long addr);
 unsigned char SD_WriteMultiBlockInit(unsigned long addr); 
 unsigned char SD_WriteMultiBlockEnd(); 
 unsigned char SD_WriteBlockDMA(unsigned long addr, unsigned char *send_ptr);
+unsigned char SD_WriteMultiBlockDMA(unsigned char *send_ptr);
+unsigned char SD_WriteDMAEnd(void);
+unsigned char SD_DMABusy(void);
+unsigned char *SD_DMABuffer(void);
+void SD_DMAComplete(void);
+void SD_StartDMA(unsigned char token, unsigned char *send_ptr);
 unsigned char SD_ReadStatus(unsigned char *buf);
 unsigned char SD_PreEraseBlocks(unsigned int blocks);
 unsigned char InitSD();
@@ -65,9 +65,8 @@ unsigned int SPI1Read16(void) {
  */
 
 void SPI1Write16(unsigned int data) {
-	unsigned int temp; 
 	SPI1STATbits.SPIROV = 0;        // clear out any rx overflow 
-  	temp = SPI1BUF;                 // dummy read to clear flag 
+  	(void)SPI1BUF;                  // dummy read to clear flag 
   	while (SPI1STATbits.SPITBF);    // wait for TX buffer to dump 
   	SPI1BUF = data; 
   	while(!SPI1STATbits.SPIRBF); 
@@ -79,9 +78,13 @@ void SPI1Write16(unsigned int data) {
 
 /*! \brief Writes a block in a multi-block write using 16bit SPI
  *
- *	Writes a single block. The write must have been initialized using SD_WriteMultiBlock(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
+ *	Writes a single block. The write must have been initialized using SD_WriteMultiBlockInit(). See section 7.2.4 of the SD Card Physical Layer Simplified Specification Version 3.01
  *  Enables MODE16 in SPI1 to increase speeds and then disables it afterward for support of other SPI1 functions. 
  *
+ *  The data token, 512 data bytes and 2 CRC bytes make an odd number of bytes, so the token shares the first word with data[0] and
+ *  the last data byte shares a word with the first CRC byte. The word that clocks out the second CRC byte brings back the first
+ *  byte of the card's reply, so the data response token can arrive in either half of a word and is searched for byte by byte.
+ *
  * \sa SD_WriteMultiBlockInit(), SD_WriteMultiBlockEnd(), SDI1Write16()
  *
  */
@@ -90,55 +93,71 @@ unsigned char SD_WriteMultiBlock16(unsigned char *data) {
     unsigned int inc = 0;
     unsigned int status = 0;
     unsigned int temp = 0; //used to store the combination of two bytes into one int
+    unsigned char token = 0;
+    unsigned long busy = 0;
     
-    
+    SPI1_16bit(1);
     CS1_PIN = 0; //enabled SD card 
    	
-   	 
-   	temp = 0; 
-   	temp |= 0xFC00; 
-   	temp |= (*data); 
+   	temp = 0xFC00 | *data; //data token + first byte
    	data++;
-   	
-   	SPI1Write16(temp); //send data token
-  	
-  	Nop(); 
+   	SPI1Write16(temp);
   	
-	//temp = 0xAAAA;
-	for(inc = 0; inc < 255; inc++) {
-		temp = 0; 
-		temp |= (*data) << 8;
+	for(inc = 0; inc < (BLOCK_SIZE/2) - 1; inc++) {
+		temp = (*data) << 8;
 		data++; 
 		temp |= *data; 
 		data++;
 		SPI1Write16(temp);
 	}
 	    
-	temp = 0; 
-	temp |= (*data) << 8;
-	temp |= 0x00FF; 
-	    
-    SPI1Write16(temp); //send CRC
-    SPI1Write16(0xFFFF); 
+	temp = ((*data) << 8) | 0x00FF; //last byte + CRC
+    SPI1Write16(temp);
+    status = SPI1Read16(); //second CRC byte, then the first byte of the response
   	
      /*After receiving the data the card will return a data token.
      * The data token format is:
-         0bXXX00101 = successful write */
+         0bXXX00101 = successful write
+         0bXXX01011 = CRC error
+         0bXXX01101 = write error*/
 
+    token = status & 0xFF;
+    status = 0x0000; //the token is the newest byte, the busy signal has not been seen yet
     inc = 0;
-    do {
+    while((token & 0x11) != 0x01) { //wait for data token
 		if(inc++ > MULTI_TOKEN_TIMEOUT) {
-            Nop(); Nop(); 
+            CS1_PIN = 1;
+            SPI1_16bit(0);
             return 2; /*! \return 2 = Error: no data token response*/
-  			
   		}      
         status = SPI1Read16();
-    } while(status != 0xFFFF);//   (status & 0x1F) != 0x05); //wait for data token
+        token = status >> 8;
+        if((token & 0x11) != 0x01) {
+            token = status & 0xFF;
+            status = 0x0000;
+        }
+    }
+
+    if((token & 0x1F) != 0x05) {
+        CS1_PIN = 1;
+        SPI1_16bit(0);
+        return 3; /*! \return 3 = Error: block rejected (CRC or write error) */
+    }
+
+    //the sd card holds the data line low until the block is written, so the newest byte tells if it is still busy
+    while((status & 0x00FF) == 0x00) {
+        if(busy++ > WRITE_BUSY_TIMEOUT16) {
+            CS1_PIN = 1;
+            SPI1_16bit(0);
+            return 4; /*! \return 4 = Error: card still busy after WRITE_BUSY_TIMEOUT16 reads */
+        }
+        status = SPI1Read16();
+    }
 
 	CS1_PIN = 1; 
-	
+	SPI1_16bit(0);
 
-    return 0;
+    return 0; /*! \return 0 = block written */
      
 }
 
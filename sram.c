@@ -0,0 +1,69 @@
+/*! \file sram.c
+    \brief Staging memory between the ADC and the SD card
+
+    The sram.h interface was written for an external SRAM behind the address
+    pins, but the ferminator2000 board (see ferminator2000.sch and bom.xls)
+    has no memory part. The staging memory is SRAM_SIZE bytes of internal
+    RAM instead. It keeps the same interface, so only this file changes if
+    a memory part is added.
+
+    Byte access goes through an address register that auto-increments and
+    wraps at SRAM_SIZE, like the address counter of a serial SRAM. The ISR
+    must not use it, because the main loop owns it. memory_block() is the
+    burst path: it returns the BLOCK_SIZE bytes at a block-aligned address
+    in place, so a block goes to the card with no byte-by-byte reads.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "sram.h"
+
+#if (SRAM_SIZE & (SRAM_SIZE-1)) || (SRAM_SIZE % BLOCK_SIZE)
+#error "SRAM_SIZE must be a power of 2 and a multiple of BLOCK_SIZE"
+#endif
+
+static volatile unsigned char sram_buffer[SRAM_SIZE];
+static unsigned int sram_address = 0; ///next byte memory_read()/memory_write() access
+
+/*! \brief Writes a byte at the address register and advances it
+ */
+
+void memory_write(unsigned char sram_data) {
+    sram_buffer[sram_address] = sram_data;
+    sram_address = (sram_address + 1) & (SRAM_SIZE-1);
+}
+
+/*! \brief Reads a byte at the address register and advances it
+ */
+
+unsigned char memory_read() {
+    unsigned char sram_data = sram_buffer[sram_address];
+
+    sram_address = (sram_address + 1) & (SRAM_SIZE-1);
+    return sram_data; /*! \return byte at the old address */
+}
+
+/*! \brief Loads the address register (wraps at SRAM_SIZE)
+ */
+
+void set_memory_address(unsigned long buff_pointer) {
+    sram_address = buff_pointer & (SRAM_SIZE-1);
+}
+
+/*! \brief Returns the address register
+ */
+
+unsigned long get_memory_address() {
+    return sram_address; /*! \return next address memory_read()/memory_write() will access */
+}
+
+/*! \brief Burst access to one block
+ *
+ *  buff_pointer is rounded down to a BLOCK_SIZE boundary and wraps at
+ *  SRAM_SIZE. The address register is not changed, so the ISR may use it.
+ */
+
+unsigned char *memory_block(unsigned long buff_pointer) {
+    return (unsigned char *)&sram_buffer[buff_pointer & (SRAM_SIZE-1) & ~(BLOCK_SIZE-1)]; /*! \return pointer to BLOCK_SIZE contiguous bytes */
+}
@@ -1,10 +1,13 @@
 #ifndef INC_SRAM_H
 #define INC_SRAM_H
 
-inline void memory_write(unsigned char sram_data); 
-inline unsigned char memory_read();
-inline void set_memory_address(unsigned long buff_pointer);
-inline unsigned long get_memory_address();
+#define SRAM_SIZE BUFFER_SIZE ///bytes of staging memory (power of 2, multiple of BLOCK_SIZE)
+
+void memory_write(unsigned char sram_data); 
+unsigned char memory_read();
+void set_memory_address(unsigned long buff_pointer);
+unsigned long get_memory_address();
+unsigned char *memory_block(unsigned long buff_pointer);
 
 #endif
 
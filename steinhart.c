@@ -0,0 +1,84 @@
+/*! \file steinhart.c
+    \brief Fixed-point Steinhart-Hart thermistor conversion
+
+    Computes thermistor temperatures directly instead of from a lookup table,
+    using the dsPIC DSP engine (fractional MPY/MAC into accumulator A) for
+    the polynomial. Each probe can have its own coefficients.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "steinhart.h"
+
+#define LN2_Q15 22713 ///ln(2) in Q15
+
+/* 100k NTC thermistor with the 10k pull-up (T1/T2). Least-squares fit to the
+ * original 1 degree C table over 0-200 C, fit error < 0.01 C. */
+const steinhartCoeffs steinhart_100k = {{-1187, 16491, -5, -2}};
+
+/* log2(1 + i/64) in Q15, used to interpolate the mantissa of log2() */
+static const unsigned int log2_frac[65] = {
+    0, 733, 1455, 2166, 2866, 3556, 4236, 4907,
+    5568, 6220, 6863, 7498, 8124, 8742, 9352, 9954,
+    10549, 11136, 11716, 12289, 12855, 13415, 13968, 14514,
+    15055, 15589, 16117, 16639, 17156, 17667, 18173, 18673,
+    19168, 19658, 20143, 20623, 21098, 21568, 22034, 22495,
+    22952, 23404, 23852, 24296, 24736, 25172, 25604, 26031,
+    26455, 26876, 27292, 27705, 28114, 28520, 28922, 29321,
+    29717, 30109, 30498, 30884, 31267, 31647, 32024, 32397,
+    32768
+};
+
+/*! \brief Base 2 logarithm of a 16 bit integer
+ *
+ * \return log2(n) in unsigned Q4.12 (n must be non-zero and below 0xFFF0)
+ */
+
+static unsigned int log2_q12(unsigned int n) {
+    unsigned int shift = __builtin_ff1l(n) - 1; //leading zeros
+    unsigned int mantissa = n << shift; //normalised to 1.15 (0x8000-0xFFFF)
+    unsigned int index = (mantissa >> 9) & 0x3F;
+    unsigned int fraction = log2_frac[index];
+
+    fraction += __builtin_muluu(log2_frac[index+1] - fraction, mantissa & 0x1FF) >> 9;
+
+    return ((15 - shift) << 12) + ((fraction + 4) >> 3);
+}
+
+/*! \brief Converts a thermistor block sum to temperature
+ *
+ *  adc_accum is the sum of 16 12-bit samples of the divider, so the
+ *  thermistor to pull-up resistance ratio is adc_accum / (2^16 - adc_accum).
+ *  Its natural log is computed with log2_q12(), the polynomial is evaluated
+ *  with Horner's rule on accumulator A and the result is inverted with a
+ *  single 32/16 divide.
+ *
+ * \return temperature in hundredths of a degree C
+ */
+
+int steinhart_convert(unsigned int adc_accum, const steinhartCoeffs *pCoeffs) {
+    register int acc asm("A");
+    int l = 0;
+    int y = 0;
+    int k = 0;
+
+    if(adc_accum < STEINHART_ACCUM_MIN) {
+        adc_accum = STEINHART_ACCUM_MIN;
+    } else if(adc_accum > (unsigned int)(0x10000UL - STEINHART_ACCUM_MIN)) {
+        adc_accum = (unsigned int)(0x10000UL - STEINHART_ACCUM_MIN);
+    }
+
+    //l = (log2(adc_accum) - log2(2^16 - adc_accum)) * ln(2) / 8
+    acc = __builtin_mpy((int)(log2_q12(adc_accum) - log2_q12(0 - adc_accum)), LN2_Q15, 0, 0, 0, 0, 0, 0);
+    l = __builtin_sacr(acc, 0);
+
+    y = pCoeffs->d[STEINHART_ORDER];
+    for(k = STEINHART_ORDER-1; k >= 0; k--) {
+        acc = __builtin_lac(pCoeffs->d[k], 0);
+        acc = __builtin_mac(acc, y, l, 0, 0, 0, 0, 0, 0, 0, 0);
+        y = __builtin_sacr(acc, 0);
+    }
+
+    //T = 2^23 / (y + STEINHART_Y_REF)
+    return (int)(__builtin_divud(STEINHART_T_SCALE, y + STEINHART_Y_REF) - 27315);
+}
@@ -0,0 +1,22 @@
+
+#ifndef INC_STEINHART_H
+#define INC_STEINHART_H
+
+#define STEINHART_ORDER     3       ///cubic in ln(R)
+#define STEINHART_ACCUM_MIN 1024    ///block sums are clamped to [MIN, 2^16 - MIN] (about -10 C to 290 C for the 100k probe)
+#define STEINHART_Y_REF     24576   ///offset removed from 2^23/T so it fits in Q15
+#define STEINHART_T_SCALE   838860800UL ///2^23 * 100, gives T in hundredths of a kelvin
+
+/* Coefficients of y = 2^23/T - STEINHART_Y_REF as a polynomial in
+ * l = ln(adc_accum / (2^16 - adc_accum)) / 8, all in Q15. The divider
+ * resistor is folded into the coefficients, which is why the usual
+ * Steinhart-Hart form gains an l^2 term. */
+typedef struct steinhartCoeffs {
+    int d[STEINHART_ORDER+1]; //d[0] + d[1]*l + d[2]*l^2 + d[3]*l^3
+}steinhartCoeffs;
+
+extern const steinhartCoeffs steinhart_100k;
+
+int steinhart_convert(unsigned int adc_accum, const steinhartCoeffs *pCoeffs);
+
+#endif
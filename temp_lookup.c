@@ -1,414 +1,89 @@
 /*! \file temp_lookup.c
     \brief Contains lookup tables for temperatures
 
+    Generated by tools/thermgen.c -- do not edit, regenerate instead:
 
+        thermgen temp_lookup \
+            100k:sh=5.244204925e-4,2.458171845e-4,-3.128246015e-10:rpullup=10000:min=0:max=200 \
+            10k:beta=3950:r25=10000:rpullup=10000:min=-20:max=150
 */
 
-unsigned int lookup_adc_0 [] = {
-    63710,
-    63611,
-    63507,
-    63399,
-    63287,
-    63169,
-    63046,
-    62919,
-    62786,
-    62647,
-    62503,
-    62354,
-    62198,
-    62036,
-    61869,
-    61695,
-    61514,
-    61327,
-    61133,
-    60932,
-    60725,
-    60510,
-    60288,
-    60059,
-    59822,
-    59578,
-    59326,
-    59067,
-    58800,
-    58524,
-    58241,
-    57950,
-    57651,
-    57344,
-    57028,
-    56705,
-    56373,
-    56034,
-    55686,
-    55330,
-    54966,
-    54594,
-    54214,
-    53827,
-    53431,
-    53028,
-    52617,
-    52199,
-    51774,
-    51341,
-    50902,
-    50455,
-    50002,
-    49543,
-    49077,
-    48606,
-    48128,
-    47645,
-    47157,
-    46664,
-    46166,
-    45663,
-    45156,
-    44646,
-    44131,
-    43614,
-    43093,
-    42570,
-    42044,
-    41516,
-    40986,
-    40455,
-    39922,
-    39389,
-    38855,
-    38320,
-    37786,
-    37252,
-    36719,
-    36187,
-    35656,
-    35126,
-    34598,
-    34072,
-    33548,
-    33027,
-    32509,
-    31994,
-    31482,
-    30973,
-    30468,
-    29967,
-    29470,
-    28977,
-    28489,
-    28005,
-    27526,
-    27051,
-    26582,
-    26118,
-    25659,
-    25205,
-    24757,
-    24315,
-    23878,
-    23446,
-    23021,
-    22601,
-    22187,
-    21779,
-    21376,
-    20980,
-    20590,
-    20205,
-    19827,
-    19455,
-    19088,
-    18728,
-    18373,
-    18024,
-    17681,
-    17344,
-    17013,
-    16688,
-    16368,
-    16054,
-    15746,
-    15443,
-    15146,
-    14854,
-    14568,
-    14287,
-    14011,
-    13741,
-    13475,
-    13215,
-    12960,
-    12710,
-    12464,
-    12224,
-    11988,
-    11757,
-    11530,
-    11308,
-    11091,
-    10877,
-    10668,
-    10463,
-    10263,
-    10066,
-    9874,
-    9685,
-    9500,
-    9319,
-    9142,
-    8969,
-    8798,
-    8632,
-    8469,
-    8309,
-    8153,
-    7999,
-    7849,
-    7703,
-    7559,
-    7418,
-    7280,
-    7145,
-    7012,
-    6883,
-    6756,
-    6632,
-    6510,
-    6391,
-    6274,
-    6160,
-    6048,
-    5939,
-    5831,
-    5726,
-    5623,
-    5522,
-    5424,
-    5327,
-    5232,
-    5139,
-    5049,
-    4960,
-    4872,
-    4787,
-    4703,
-    4621,
-    4541,
-    4462,
-    4385,
-    4310,
-    4236,
-    4163,
-    4092,
-    4023,
-    3954
+#include "temp_lookup.h"
+
+/* 100k: 257 entries, 0 to 200 C */
+static const int thermistor_100k_data[257] __attribute__((space(auto_psv))) = {
+     32000,  32000,  28221,  25254,  23346,  21964,  20892,  20022,
+     19294,  18670,  18126,  17643,  17212,  16821,  16465,  16138,
+     15836,  15555,  15293,  15048,  14817,  14599,  14393,  14197,
+     14011,  13834,  13664,  13502,  13346,  13196,  13052,  12914,
+     12780,  12650,  12525,  12404,  12286,  12172,  12062,  11954,
+     11849,  11747,  11648,  11551,  11456,  11364,  11273,  11185,
+     11098,  11014,  10931,  10850,  10770,  10692,  10615,  10540,
+     10466,  10393,  10322,  10251,  10182,  10114,  10047,   9981,
+      9916,   9852,   9789,   9726,   9665,   9604,   9544,   9485,
+      9427,   9369,   9312,   9255,   9200,   9145,   9090,   9036,
+      8983,   8930,   8878,   8826,   8774,   8724,   8673,   8623,
+      8574,   8525,   8476,   8428,   8380,   8333,   8286,   8239,
+      8193,   8147,   8101,   8055,   8010,   7966,   7921,   7877,
+      7833,   7789,   7746,   7702,   7659,   7617,   7574,   7532,
+      7490,   7448,   7406,   7365,   7324,   7282,   7241,   7201,
+      7160,   7120,   7079,   7039,   6999,   6959,   6919,   6880,
+      6840,   6801,   6761,   6722,   6683,   6644,   6605,   6566,
+      6527,   6488,   6449,   6411,   6372,   6334,   6295,   6257,
+      6218,   6180,   6141,   6103,   6065,   6026,   5988,   5950,
+      5911,   5873,   5835,   5796,   5758,   5719,   5681,   5642,
+      5604,   5565,   5527,   5488,   5449,   5410,   5371,   5332,
+      5293,   5254,   5214,   5175,   5135,   5096,   5056,   5016,
+      4976,   4936,   4895,   4854,   4814,   4773,   4732,   4690,
+      4649,   4607,   4565,   4523,   4480,   4437,   4394,   4351,
+      4307,   4263,   4219,   4174,   4129,   4084,   4038,   3992,
+      3946,   3899,   3851,   3804,   3755,   3706,   3657,   3607,
+      3557,   3505,   3454,   3401,   3348,   3294,   3239,   3184,
+      3128,   3070,   3012,   2953,   2893,   2831,   2769,   2705,
+      2640,   2573,   2505,   2436,   2364,   2291,   2216,   2139,
+      2059,   1977,   1893,   1805,   1714,   1620,   1522,   1419,
+      1312,   1199,   1081,    955,    821,    678,    525,    358,
+       175,    -29,   -257,   -521,   -834,  -1222,  -1743,  -2573,
+     -7773
 };
 
-unsigned char lookup_temp_0 [] = {
-    0,
-    1,
-    2,
-    3,
-    4,
-    5,
-    6,
-    7,
-    8,
-    9,
-    10,
-    11,
-    12,
-    13,
-    14,
-    15,
-    16,
-    17,
-    18,
-    19,
-    20,
-    21,
-    22,
-    23,
-    24,
-    25,
-    26,
-    27,
-    28,
-    29,
-    30,
-    31,
-    32,
-    33,
-    34,
-    35,
-    36,
-    37,
-    38,
-    39,
-    40,
-    41,
-    42,
-    43,
-    44,
-    45,
-    46,
-    47,
-    48,
-    49,
-    50,
-    51,
-    52,
-    53,
-    54,
-    55,
-    56,
-    57,
-    58,
-    59,
-    60,
-    61,
-    62,
-    63,
-    64,
-    65,
-    66,
-    67,
-    68,
-    69,
-    70,
-    71,
-    72,
-    73,
-    74,
-    75,
-    76,
-    77,
-    78,
-    79,
-    80,
-    81,
-    82,
-    83,
-    84,
-    85,
-    86,
-    87,
-    88,
-    89,
-    90,
-    91,
-    92,
-    93,
-    94,
-    95,
-    96,
-    97,
-    98,
-    99,
-    100,
-    101,
-    102,
-    103,
-    104,
-    105,
-    106,
-    107,
-    108,
-    109,
-    110,
-    111,
-    112,
-    113,
-    114,
-    115,
-    116,
-    117,
-    118,
-    119,
-    120,
-    121,
-    122,
-    123,
-    124,
-    125,
-    126,
-    127,
-    128,
-    129,
-    130,
-    131,
-    132,
-    133,
-    134,
-    135,
-    136,
-    137,
-    138,
-    139,
-    140,
-    141,
-    142,
-    143,
-    144,
-    145,
-    146,
-    147,
-    148,
-    149,
-    150,
-    151,
-    152,
-    153,
-    154,
-    155,
-    156,
-    157,
-    158,
-    159,
-    160,
-    161,
-    162,
-    163,
-    164,
-    165,
-    166,
-    167,
-    168,
-    169,
-    170,
-    171,
-    172,
-    173,
-    174,
-    175,
-    176,
-    177,
-    178,
-    179,
-    180,
-    181,
-    182,
-    183,
-    184,
-    185,
-    186,
-    187,
-    188,
-    189,
-    190,
-    191,
-    192,
-    193,
-    194,
-    195,
-    196,
-    197,
-    198,
-    199,
-    200
+const thermistorTable thermistor_100k = {thermistor_100k_data, 8, 0, 20000};
+
+/* 10k: 257 entries, -20 to 150 C */
+static const int thermistor_10k_data[257] __attribute__((space(auto_psv))) = {
+     32000,  19149,  15748,  14002,  12853,  12009,  11346,  10803,
+     10346,   9951,   9605,   9296,   9019,   8767,   8537,   8325,
+      8128,   7945,   7774,   7613,   7461,   7317,   7181,   7052,
+      6928,   6811,   6698,   6590,   6486,   6386,   6289,   6196,
+      6107,   6020,   5935,   5854,   5775,   5698,   5623,   5550,
+      5479,   5410,   5342,   5276,   5212,   5149,   5088,   5027,
+      4969,   4911,   4854,   4799,   4744,   4690,   4638,   4586,
+      4535,   4485,   4436,   4388,   4340,   4293,   4247,   4202,
+      4157,   4112,   4069,   4026,   3983,   3941,   3900,   3859,
+      3818,   3778,   3738,   3699,   3660,   3622,   3584,   3547,
+      3509,   3473,   3436,   3400,   3364,   3329,   3293,   3259,
+      3224,   3190,   3156,   3122,   3088,   3055,   3022,   2989,
+      2957,   2924,   2892,   2860,   2828,   2797,   2766,   2734,
+      2703,   2673,   2642,   2611,   2581,   2551,   2521,   2491,
+      2461,   2432,   2402,   2373,   2343,   2314,   2285,   2256,
+      2227,   2199,   2170,   2142,   2113,   2085,   2056,   2028,
+      2000,   1972,   1944,   1916,   1888,   1860,   1832,   1805,
+      1777,   1749,   1721,   1694,   1666,   1639,   1611,   1583,
+      1556,   1528,   1501,   1473,   1446,   1418,   1391,   1363,
+      1336,   1308,   1281,   1253,   1225,   1198,   1170,   1142,
+      1114,   1087,   1059,   1031,   1003,    975,    947,    918,
+       890,    862,    833,    805,    776,    747,    718,    689,
+       660,    631,    602,    572,    543,    513,    483,    453,
+       422,    392,    361,    331,    300,    268,    237,    205,
+       174,    141,    109,     76,     44,     10,    -23,    -57,
+       -91,   -125,   -160,   -195,   -231,   -267,   -303,   -340,
+      -377,   -415,   -453,   -491,   -531,   -570,   -611,   -652,
+      -693,   -736,   -779,   -823,   -867,   -913,   -959,  -1006,
+     -1055,  -1104,  -1155,  -1207,  -1260,  -1314,  -1370,  -1428,
+     -1487,  -1549,  -1612,  -1678,  -1746,  -1816,  -1890,  -1967,
+     -2048,  -2133,  -2223,  -2317,  -2419,  -2527,  -2644,  -2770,
+     -2910,  -3065,  -3240,  -3442,  -3682,  -3982,  -4386,  -5034,
+     -9228
 };
 
+const thermistorTable thermistor_10k = {thermistor_10k_data, 8, -2000, 15000};
@@ -1,10 +1,18 @@
+/* Generated by tools/thermgen.c -- do not edit, regenerate instead */
+
 #ifndef INC_TEMP_LOOKUP_H
 #define INC_TEMP_LOOKUP_H
 
-extern unsigned int     lookup_adc_0;
-extern unsigned char    lookup_temp_0;
+#define THERMISTOR_TABLE_FRAC 3 ///table entries are tenths of a degree C << 3
 
-#define LOOKUP_0_LENGTH 201
+typedef struct thermistorTable {
+    const int *data; //temperature at adc_accum = n << shift (1/80 C)
+    unsigned char shift; //accumulator bits per table step
+    int min; //lowest calibrated temperature (hundredths of a degree C)
+    int max; //highest calibrated temperature (hundredths of a degree C)
+}thermistorTable;
 
+extern const thermistorTable thermistor_100k;
+extern const thermistorTable thermistor_10k;
 
-#endif
\ No newline at end of file
+#endif
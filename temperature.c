@@ -0,0 +1,180 @@
+/*! \file temperature.c
+    \brief Converts raw ADC blocks to probe temperatures
+
+    _DMA1Interrupt() only sums the DMA buffers and queues the raw block sums
+    (see adc_queue.c). The outlier filter (prefilter.c), the decimation
+    filter (decimate.c) and the conversion to temperature run here, from the
+    main loop, so they never delay the display ISR. Every new T0 reading
+    also logs a sample of all three probes (see log_ring.c).
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "adc_queue.h"
+#include "prefilter.h"
+#include "decimate.h"
+#include "temp_lookup.h"
+#include "steinhart.h"
+#include "thermocouple.h"
+#include "log_ring.h"
+#include "temperature.h"
+
+static int probe_temp[ADC_NUM_CHANNELS]; ///latest temperature of each probe (hundredths of a degree C)
+static unsigned long probe_timestamp = 0; ///timestamp of the block the latest reading came from
+static prefilterStage probe_prefilter[ADC_NUM_CHANNELS]; ///outlier filter of each probe
+static decimateStage probe_filter[ADC_NUM_CHANNELS]; ///decimation filter of each probe
+static int t0_cj_offset = 0; ///T0 cold junction term (see thermocouple_cj_offset()), cached from the last board temperature
+
+#if THERMISTOR_STEINHART
+/* Steinhart-Hart coefficients for each probe (unused for the thermocouple) */
+static const steinhartCoeffs *probe_coeffs[ADC_NUM_CHANNELS] = {
+    0,                  //T0: thermocouple
+    &steinhart_100k,    //T1
+    &steinhart_100k     //T2
+};
+#else
+/* Lookup table for each probe (unused for the thermocouple). The tables are
+ * generated by tools/thermgen.c; thermistor_100k is the stock probe. */
+static const thermistorTable *probe_tables[ADC_NUM_CHANNELS] = {
+    0,                  //T0: thermocouple
+    &thermistor_100k,   //T1
+    &thermistor_100k    //T2
+};
+#endif
+
+/*! \brief Converts a thermistor (T1/T2) block sum to temperature
+ *
+ *  T1_AN and T2_AN are thermistor inputs (100k). With THERMISTOR_STEINHART
+ *  the temperature is computed from the probe's own Steinhart-Hart
+ *  coefficients (see steinhart.c).
+ *
+ *  Otherwise the top bits of the block sum index the probe's table directly
+ *  and the low pTable->shift bits interpolate to the next entry, so the cost
+ *  is the same at every temperature: no table search and no divide.
+ *
+ * \return temperature in hundredths of a degree C
+ */
+
+static int convert_thermistor(unsigned char probe, unsigned int adc_accum) {
+#if THERMISTOR_STEINHART
+    return steinhart_convert(adc_accum, probe_coeffs[probe]);
+#else
+    const thermistorTable *pTable = probe_tables[probe];
+    unsigned int index = adc_accum >> pTable->shift;
+    unsigned int fraction = adc_accum & ((1 << pTable->shift) - 1);
+    int temp_low = pTable->data[index];
+    int temp_high = pTable->data[index+1];
+    int temp = 0;
+
+    temp = temp_low + (int)((((long)temp_high - temp_low) * fraction) >> pTable->shift);
+    if(temp > THERMISTOR_SCALE_MAX) { //the tables saturate at 400 C, which would overflow below
+        temp = THERMISTOR_SCALE_MAX;
+    }
+    temp += (temp + 2) >> 2; //1/80 C -> 1/100 C (THERMISTOR_TABLE_FRAC = 3)
+
+    //the table is only calibrated between pTable->min and pTable->max
+    if(temp < pTable->min) {
+        temp = pTable->min;
+    } else if(temp > pTable->max) {
+        temp = pTable->max;
+    }
+
+    return temp;
+#endif
+}
+
+/*! \brief Sets up the per-probe outlier and decimation filters and the T0 cold junction term
+ */
+
+unsigned char temperature_init(void) {
+    unsigned char error = 0;
+
+    t0_cj_offset = thermocouple_cj_offset(THERMOCOUPLE_CJ_DEFAULT);
+
+    prefilter_init(&probe_prefilter[T0_PROBE], T0_SLEW_MAX);
+    prefilter_init(&probe_prefilter[T1_PROBE], T1_SLEW_MAX);
+    prefilter_init(&probe_prefilter[T2_PROBE], T2_SLEW_MAX);
+
+    error |= decimate_init(&probe_filter[T0_PROBE], T0_DECIMATE_RATIO);
+    error |= decimate_init(&probe_filter[T1_PROBE], T1_DECIMATE_RATIO);
+    error |= decimate_init(&probe_filter[T2_PROBE], T2_DECIMATE_RATIO);
+
+    return error; /*! \return 0 = success, 1 = a ratio in defs.h is not supported */
+}
+
+/*! \brief Filters and converts every queued ADC block (call from the main loop)
+ *
+ *  Drains the ADC queue through the outlier filters into the decimation
+ *  filters. A probe's temperature is only converted when its decimation
+ *  filter produces an output, i.e. once every Tx_DECIMATE_RATIO
+ *  conversions. Should be called at least once every ADC_QUEUE_LENGTH DMA
+ *  blocks or blocks are dropped (counted in adc_queue_overflows).
+ */
+
+unsigned char temperature_task(void) {
+    adcRecord record;
+    logSample sample;
+    unsigned int adc_accum;
+    unsigned char t0_ready;
+
+    while(adc_queue_pop(&record) == 0) {
+        record.accum[T0_PROBE] = prefilter_push(&probe_prefilter[T0_PROBE], record.accum[T0_PROBE]);
+        record.accum[T1_PROBE] = prefilter_push(&probe_prefilter[T1_PROBE], record.accum[T1_PROBE]);
+        record.accum[T2_PROBE] = prefilter_push(&probe_prefilter[T2_PROBE], record.accum[T2_PROBE]);
+
+        t0_ready = 0;
+        if(decimate_push(&probe_filter[T0_PROBE], record.accum[T0_PROBE], &adc_accum) == 0) {
+            probe_temp[T0_PROBE] = thermocouple_convert(adc_accum, t0_cj_offset);
+            probe_timestamp = record.timestamp;
+            t0_ready = 1;
+        }
+        if(decimate_push(&probe_filter[T1_PROBE], record.accum[T1_PROBE], &adc_accum) == 0) {
+            probe_temp[T1_PROBE] = convert_thermistor(T1_PROBE, adc_accum);
+            probe_timestamp = record.timestamp;
+        }
+        if(decimate_push(&probe_filter[T2_PROBE], record.accum[T2_PROBE], &adc_accum) == 0) {
+            probe_temp[T2_PROBE] = convert_thermistor(T2_PROBE, adc_accum);
+            probe_timestamp = record.timestamp;
+        }
+
+        if(t0_ready) { //T0 is the slowest probe, so log at its rate
+            sample.timestamp = record.timestamp;
+            sample.temp[T0_PROBE] = probe_temp[T0_PROBE];
+            sample.temp[T1_PROBE] = probe_temp[T1_PROBE];
+            sample.temp[T2_PROBE] = probe_temp[T2_PROBE];
+            log_ring_push(&sample); //a full ring is counted in log_ring_overflows
+        }
+    }
+
+    return 0; /*! \return 0 = success */
+}
+
+/*! \brief Updates the T0 cold junction correction from a board temperature
+ *
+ *  Call at a low rate (see RTC_TEMP_PERIOD) with rtc_read_temperature(). The
+ *  correction is computed once here and cached, so temperature_task() does
+ *  no extra work and never touches the I2C bus.
+ */
+
+void temperature_set_board(int board_temp) {
+    t0_cj_offset = thermocouple_cj_offset(board_temp);
+}
+
+/*! \brief Returns the latest temperature of a probe
+ *
+ * \return temperature in hundredths of a degree C (T0_PROBE, T1_PROBE or T2_PROBE)
+ */
+
+int temperature_read(unsigned char probe) {
+    return probe_temp[probe];
+}
+
+/*! \brief Returns the timestamp of the block the latest reading came from
+ *
+ * \return timebase_read() ticks
+ */
+
+unsigned long temperature_timestamp(void) {
+    return probe_timestamp;
+}
@@ -0,0 +1,11 @@
+
+#ifndef INC_TEMPERATURE_H
+#define INC_TEMPERATURE_H
+
+unsigned char temperature_init(void);
+unsigned char temperature_task(void);
+void temperature_set_board(int board_temp);
+int temperature_read(unsigned char probe);
+unsigned long temperature_timestamp(void);
+
+#endif
@@ -0,0 +1,126 @@
+/*! \file thermocouple.c
+    \brief Type K thermocouple conversion for the AD8495 (T0)
+
+    The AD8495 amplifies the thermocouple voltage by 122.4 and adds its own
+    cold junction compensation, which is only a straight line (5 mV/C at the
+    output, 40.85 uV/C at the input):
+
+        Vout = 122.4 * (E(Tmj) - E(Tcj) + 40.85uV * Tcj)
+
+    where E() is the NIST ITS-90 type K EMF. Dividing by 5 mV/C treats E() as
+    a straight line too, which is off by several degrees away from ambient.
+    thermocouple_convert() instead rebuilds E(Tmj) from the ADC block sum and
+    a cold junction term, and looks the temperature up in a table of the NIST
+    inverse polynomial, with linear interpolation and no divides.
+
+    Units: one block sum count is 2.5V / 2^16 at the output, i.e.
+    2.5V / (2^16 * 122.4) = 0.3117 uV of thermocouple EMF.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "thermocouple.h"
+
+/* Temperature (1/64 C) at EMF = n << THERMOCOUPLE_SHIFT block sum counts,
+ * from the NIST ITS-90 type K inverse polynomial for 0 to 500 C (0 to
+ * 20.644 mV, +/-0.06 C). */
+static const int thermocouple_k[257] __attribute__((space(auto_psv))) = {
+        0,   128,   256,   384,   512,   640,   768,   896,
+     1023,  1151,  1278,  1405,  1531,  1658,  1784,  1910,
+     2036,  2161,  2287,  2412,  2537,  2661,  2786,  2910,
+     3034,  3158,  3282,  3405,  3529,  3652,  3775,  3898,
+     4021,  4144,  4267,  4390,  4512,  4635,  4758,  4880,
+     5003,  5126,  5249,  5371,  5494,  5617,  5740,  5863,
+     5986,  6109,  6233,  6356,  6479,  6603,  6727,  6851,
+     6975,  7099,  7223,  7347,  7472,  7597,  7721,  7846,
+     7971,  8097,  8222,  8348,  8473,  8599,  8725,  8851,
+     8977,  9104,  9230,  9356,  9483,  9610,  9737,  9864,
+     9991, 10118, 10245, 10373, 10500, 10627, 10755, 10882,
+    11010, 11138, 11265, 11393, 11521, 11649, 11776, 11904,
+    12032, 12160, 12287, 12415, 12543, 12671, 12798, 12926,
+    13053, 13181, 13308, 13436, 13563, 13691, 13818, 13945,
+    14072, 14199, 14326, 14453, 14579, 14706, 14833, 14959,
+    15085, 15212, 15338, 15464, 15590, 15716, 15841, 15967,
+    16093, 16218, 16343, 16469, 16594, 16719, 16844, 16968,
+    17093, 17218, 17342, 17467, 17591, 17715, 17839, 17963,
+    18087, 18211, 18335, 18458, 18582, 18705, 18829, 18952,
+    19075, 19199, 19322, 19445, 19568, 19691, 19813, 19936,
+    20059, 20181, 20304, 20427, 20549, 20672, 20794, 20916,
+    21039, 21161, 21283, 21405, 21527, 21649, 21771, 21893,
+    22015, 22137, 22259, 22381, 22503, 22625, 22746, 22868,
+    22990, 23112, 23233, 23355, 23476, 23598, 23719, 23841,
+    23962, 24084, 24205, 24326, 24448, 24569, 24690, 24811,
+    24933, 25054, 25175, 25296, 25417, 25538, 25659, 25780,
+    25900, 26021, 26142, 26263, 26383, 26504, 26625, 26745,
+    26866, 26986, 27107, 27227, 27348, 27468, 27588, 27709,
+    27829, 27949, 28069, 28190, 28310, 28430, 28550, 28670,
+    28790, 28911, 29031, 29151, 29271, 29391, 29511, 29631,
+    29751, 29871, 29991, 30111, 30231, 30351, 30471, 30591,
+    30711, 30831, 30951, 31071, 31191, 31311, 31431, 31551,
+    31670
+};
+
+/* E(Tcj) - 40.85uV * Tcj in block sum counts for board temperatures from
+ * THERMOCOUPLE_CJ_MIN in steps of THERMOCOUPLE_CJ_STEP (NIST forward
+ * polynomial). This is the part of the cold junction the AD8495 gets wrong. */
+static const int thermocouple_cj[THERMOCOUPLE_CJ_ENTRIES] __attribute__((space(auto_psv))) = {
+    127, 87, 53, 24, 0, -21, -37, -51, -61, -67, -71,
+    -72, -71, -68, -62, -55, -47, -37, -26, -15, -4
+};
+
+/*! \brief Cold junction term for a board temperature (call at a low rate)
+ *
+ *  board_temp is the temperature at the AD8495 in hundredths of a degree C
+ *  and is clamped to the table range.
+ *
+ * \return offset to pass to thermocouple_convert() (block sum counts)
+ */
+
+int thermocouple_cj_offset(int board_temp) {
+    unsigned int index;
+    unsigned int fraction;
+
+    if(board_temp < THERMOCOUPLE_CJ_MIN) {
+        board_temp = THERMOCOUPLE_CJ_MIN;
+    } else if(board_temp >= THERMOCOUPLE_CJ_MAX) {
+        board_temp = THERMOCOUPLE_CJ_MAX - 1;
+    }
+
+    index = (unsigned int)(board_temp - THERMOCOUPLE_CJ_MIN) / THERMOCOUPLE_CJ_STEP;
+    fraction = (unsigned int)(board_temp - THERMOCOUPLE_CJ_MIN) % THERMOCOUPLE_CJ_STEP;
+
+    return thermocouple_cj[index] + (int)((long)(thermocouple_cj[index+1] - thermocouple_cj[index]) * fraction / THERMOCOUPLE_CJ_STEP);
+}
+
+/*! \brief Converts a thermocouple (T0) block sum to temperature
+ *
+ *  cj_offset comes from thermocouple_cj_offset(). Readings are clamped to
+ *  0 C .. THERMOCOUPLE_TEMP_MAX, the largest value that fits in hundredths.
+ *
+ * \return temperature in hundredths of a degree C
+ */
+
+int thermocouple_convert(unsigned int adc_accum, int cj_offset) {
+    long emf = (long)adc_accum + cj_offset; //E(Tmj) in block sum counts
+    unsigned int index;
+    unsigned int fraction;
+    long temp;
+
+    if(emf < 0) {
+        emf = 0;
+    } else if(emf > 0xFFFF) {
+        emf = 0xFFFF;
+    }
+
+    index = (unsigned int)emf >> THERMOCOUPLE_SHIFT;
+    fraction = (unsigned int)emf & ((1 << THERMOCOUPLE_SHIFT) - 1);
+    temp = thermocouple_k[index];
+    temp += ((thermocouple_k[index+1] - temp) * fraction) >> THERMOCOUPLE_SHIFT;
+    temp = (temp * 25 + 8) >> 4; //1/64 C -> 1/100 C
+
+    if(temp > THERMOCOUPLE_TEMP_MAX) {
+        temp = THERMOCOUPLE_TEMP_MAX;
+    }
+
+    return (int)temp;
+}
@@ -0,0 +1,16 @@
+
+#ifndef INC_THERMOCOUPLE_H
+#define INC_THERMOCOUPLE_H
+
+#define THERMOCOUPLE_SHIFT      8       ///block sum counts per table step (257 entries)
+#define THERMOCOUPLE_TEMP_MAX   32000   ///highest reported temperature (hundredths of a degree C)
+#define THERMOCOUPLE_CJ_MIN     (-2000) ///lowest board temperature in the cold junction table (hundredths of a degree C)
+#define THERMOCOUPLE_CJ_STEP    500     ///cold junction table step (hundredths of a degree C)
+#define THERMOCOUPLE_CJ_ENTRIES 21      ///-20 C to 80 C
+#define THERMOCOUPLE_CJ_MAX     (THERMOCOUPLE_CJ_MIN + (THERMOCOUPLE_CJ_ENTRIES-1)*THERMOCOUPLE_CJ_STEP)
+#define THERMOCOUPLE_CJ_DEFAULT 2500    ///board temperature assumed without a measurement
+
+int thermocouple_cj_offset(int board_temp);
+int thermocouple_convert(unsigned int adc_accum, int cj_offset);
+
+#endif
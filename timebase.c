@@ -0,0 +1,61 @@
+/*! \file timebase.c
+    \brief Free-running timestamp and cycle counters
+    
+    Timer4/5 form a 32-bit timestamp counter (FCY/256) used to stamp ADC
+    blocks and pace the main loop. When PROFILE_ISR is set, Timer1 free-runs
+    at FCY so ISRs can measure their own length in instruction cycles.
+*/
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "globals.h"
+#include "timebase.h"
+
+/*! \brief Starts the timestamp (and profiling) timers
+ */
+
+unsigned char timebase_init() {
+    //Timer4/5: 32 bit timestamp, 1:256 prescale, no interrupt
+    T4CONbits.TON = 0;
+    T4CONbits.T32 = 1; //Timer4 and Timer5 form one 32 bit timer
+    T4CONbits.TCKPS = 0b11; //1:256 prescaler
+    T4CONbits.TCS = 0; //internal clock (FOSC/2)
+    T4CONbits.TGATE = 0;
+    TMR5HLD = 0;
+    TMR4 = 0;
+    PR4 = 0xFFFF; //free-running over the full 32 bits
+    PR5 = 0xFFFF;
+    T4CONbits.TON = 1;
+
+#if PROFILE_ISR
+    //Timer1: 16 bit cycle counter, 1:1 prescale, no interrupt
+    T1CONbits.TON = 0;
+    T1CONbits.TCKPS = 0b00; //1:1 prescaler
+    T1CONbits.TCS = 0; //internal clock (FOSC/2)
+    T1CONbits.TGATE = 0;
+    TMR1 = 0;
+    PR1 = 0xFFFF;
+    T1CONbits.TON = 1;
+#endif
+
+    return 0;
+}
+
+/*! \brief Reads the 32 bit timestamp
+ *
+ *  Reading TMR4 latches TMR5 into TMR5HLD. Interrupts are held off between
+ *  the two reads so an ISR that also reads the timestamp can't replace the
+ *  latched upper word.
+ */
+
+unsigned long timebase_read(void) {
+    unsigned int lsw;
+    unsigned int msw;
+
+    __builtin_disi(0x3FFF); //disable interrupts (priority 1-6)
+    lsw = TMR4;
+    msw = TMR5HLD;
+    DISICNT = 0; //re-enable interrupts
+
+    return ((unsigned long)msw << 16) | lsw; /*! \return ticks of TIMEBASE_TICKS_PER_SECOND */
+}
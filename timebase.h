@@ -0,0 +1,15 @@
+
+#ifndef INC_TIMEBASE_H
+#define INC_TIMEBASE_H
+
+unsigned char timebase_init();
+unsigned long timebase_read(void);
+
+#if PROFILE_ISR
+/* Timer1 free-runs at FCY, so the difference of two reads is a cycle count
+ * (valid for sections shorter than 65536 cycles) */
+#define PROFILE_START(start)        start = TMR1
+#define PROFILE_END(start, max)     do { start = TMR1 - start; if(start > max) max = start; } while(0)
+#endif
+
+#endif
@@ -0,0 +1,11 @@
+/*! \file libpic30.h
+    \brief Host stand-in for the XC16 delay helpers, used by the tests in tools/
+*/
+
+#ifndef INC_HOST_LIBPIC30_H
+#define INC_HOST_LIBPIC30_H
+
+#define __delay_ms(ms)
+#define __delay_us(us)
+
+#endif
@@ -0,0 +1,108 @@
+/*! \file p33FJ256GP510A.h
+    \brief Host stand-in for the device header, used by the tests in tools/
+
+    The tests build the firmware sources with the PC's gcc. Put this
+    directory in front of the repository on the include path:
+
+        gcc -I tools/host -I . -o test tools/test_x.c ... tools/host/sfr.c
+
+    The attributes XC16 adds to registers, interrupts and flash constants
+    are mapped to ones gcc accepts, then the real header is included, so
+    every register and bit field keeps its real layout. tools/host/sfr.c
+    defines the registers as plain variables. The XC16 builtins the sources
+    use are emulated below, with the DSP engine in its reset configuration
+    (fractional multiplies, 40 bit accumulator A, conventional rounding,
+    saturation on store).
+
+    int is 32 bits here and 16 bits on the dsPIC, so a test compares 16 bit
+    results as 16 bit values.
+*/
+
+#ifndef INC_HOST_P33FJ256GP510A_H
+#define INC_HOST_P33FJ256GP510A_H
+
+#define __dsPIC33FJ256GP510A__
+#define __sfr__         unused
+#define __unsafe__      unused
+#define __interrupt__   unused
+#define auto_psv        unused
+#define no_auto_psv     unused
+#define space(x)        unused
+#define far             unused
+#define asm(x)          //register int acc asm("A"): the accumulator is host_acc below
+
+#include "../../p33FJ256GP510A.h"
+
+//the configuration words are variables in sfr.c, main.c's settings are dropped
+#undef _FOSCSEL
+#undef _FOSC
+#undef _FWDT
+#undef _FICD
+#define _FOSCSEL(x)
+#define _FOSC(x)
+#define _FWDT(x)
+#define _FICD(x)
+
+static long long host_acc; ///accumulator A
+
+static inline void __builtin_nop(void) {
+}
+
+static inline void __builtin_disi(unsigned int cycles) {
+    (void)cycles;
+}
+
+static inline unsigned int __builtin_dmaoffset(const volatile void *p) {
+    return (unsigned int)(unsigned long)p; //only the low bits matter on the host
+}
+
+/* FF1L: bit number of the first 1 counted from the MSB of a 16 bit word (1 = bit 15), 0 if none */
+static inline int __builtin_ff1l(unsigned int n) {
+    int bit = 1;
+
+    n &= 0xFFFF;
+    if(n == 0) return 0;
+    while(!(n & 0x8000)) {
+        n <<= 1;
+        bit++;
+    }
+    return bit;
+}
+
+static inline unsigned long __builtin_muluu(unsigned int a, unsigned int b) {
+    return (unsigned long)(unsigned short)a * (unsigned short)b;
+}
+
+static inline unsigned int __builtin_divud(unsigned long num, unsigned int den) {
+    return (unsigned short)((num & 0xFFFFFFFFUL) / (unsigned short)den);
+}
+
+static inline int __builtin_mpy(int a, int b, int x, int xi, int y, int yi, int px, int py) {
+    (void)x; (void)xi; (void)y; (void)yi; (void)px; (void)py;
+    host_acc = ((long long)(short)a * (short)b) << 1;
+    return 0;
+}
+
+static inline int __builtin_mac(int acc, int a, int b, int x, int xi, int y, int yi, int px, int py, int aw, int awb) {
+    (void)acc; (void)x; (void)xi; (void)y; (void)yi; (void)px; (void)py; (void)aw; (void)awb;
+    host_acc += ((long long)(short)a * (short)b) << 1;
+    return 0;
+}
+
+static inline int __builtin_lac(int value, int shift) {
+    host_acc = (long long)(short)value << 16;
+    host_acc = shift >= 0 ? host_acc >> shift : host_acc << -shift;
+    return 0;
+}
+
+static inline int __builtin_sacr(int acc, int shift) {
+    long long value = shift >= 0 ? host_acc >> shift : host_acc << -shift;
+
+    (void)acc;
+    value = (value + 0x8000) >> 16;
+    if(value > 32767) return 32767;
+    if(value < -32768) return -32768;
+    return (int)value;
+}
+
+#endif
@@ -0,0 +1,10 @@
+/*! \file sfr.c
+    \brief Host definitions of the dsPIC registers for the tests in tools/
+
+    Every register the device header declares becomes a plain zeroed
+    variable, so firmware sources link on the PC. See p33FJ256GP510A.h in
+    this directory.
+*/
+
+#define extern
+#include <p33FJ256GP510A.h>
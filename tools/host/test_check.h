@@ -0,0 +1,17 @@
+/*! \file test_check.h
+    \brief Failure counting shared by the tests in tools/
+*/
+
+#ifndef INC_HOST_TEST_CHECK_H
+#define INC_HOST_TEST_CHECK_H
+
+#include <stdio.h>
+
+#define TEST_CHECK_PRINTS   10 ///failures printed before the rest are only counted
+
+static unsigned int test_failures = 0;
+
+///counts a failure when cond is false, printing the first TEST_CHECK_PRINTS
+#define TEST_CHECK(cond, ...)   do { if(!(cond)) { if(test_failures++ < TEST_CHECK_PRINTS) { printf(__VA_ARGS__); printf("\n"); } } } while(0)
+
+#endif
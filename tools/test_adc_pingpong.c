@@ -0,0 +1,203 @@
+/*! \file test_adc_pingpong.c
+    \brief Host test of the ADC ping-pong DMA hand-off in _DMA1Interrupt()
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_adc_pingpong tools/test_adc_pingpong.c adc_queue.c globals.c tools/host/sfr.c
+        ./test_adc_pingpong
+
+    main.c is built in with main() renamed, and everything it calls apart
+    from the ADC queue is stubbed out. The test plays the DMA controller: it
+    fills dma_adc_buf_a and dma_adc_buf_b alternately, in the layout the
+    selected ADC_ACQ_MODE writes, and raises the DMA1 interrupt after each
+    one. While the ISR runs, the DMA controller is already filling the other
+    buffer. The stubbed timebase_read(), which the ISR calls before it sums,
+    simulates this by overwriting that buffer with full scale. A record that
+    picked up the wrong buffer, or a torn one, does not match.
+
+    Exits with 0 when every check passes.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#define main firmware_main
+#include "main.c"
+#undef main
+
+#define TEST_BLOCKS 64 ///DMA blocks run through the ISR
+
+static unsigned long test_now = 0; ///timebase_read() ticks
+static unsigned int *test_filling = 0; ///buffer the simulated DMA is writing while the ISR runs
+static unsigned int test_failures = 0;
+
+/* firmware main() calls these, the ISR does not */
+void init(void) {}
+unsigned char timebase_init() { return 0; }
+unsigned char lcd_init() { return 0; }
+unsigned char timer2_init() { return 0; }
+unsigned char temperature_init(void) { return 0; }
+unsigned char adc_init() { return 0; }
+unsigned char i2c_init() { return 0; }
+unsigned char uart_init() { return 0; }
+unsigned char rtc_init() { return 0; }
+void temperature_set_board(int board_temp) { (void)board_temp; }
+int rtc_read_temperature(void) { return 0; }
+unsigned char read_time(timeData *pTimeData) { (void)pTimeData; return 0; }
+unsigned char lcd_text(const unsigned char *text, unsigned char length, unsigned char passes) { (void)text; (void)length; (void)passes; return 0; }
+unsigned char sd_init(void) { return 1; }
+unsigned char logger_init(unsigned long address, timeData *pTime) { (void)address; (void)pTime; return 0; }
+unsigned char temperature_task(void) { return 0; }
+unsigned char lcd_set(int value, char dots) { (void)value; (void)dots; return 0; }
+unsigned char lcd_task(void) { return 0; }
+unsigned char lcd_schedule(unsigned char hours) { (void)hours; return 0; }
+void logger_task(void) {}
+void sd_async_task(void) {}
+void SD_DMAComplete(void) {}
+unsigned char uart_write_string(unsigned char *string, unsigned char length) { (void)string; (void)length; return 0; }
+
+/*! \brief Timestamp source, and the DMA controller filling the next buffer
+ */
+
+unsigned long timebase_read(void) {
+    unsigned int inc;
+
+    if(test_filling != 0) {
+        for(inc = 0; inc < ADC_DMA_BUF_LENGTH; inc++) {
+            test_filling[inc] = 0x0FFF;
+        }
+    }
+    return ++test_now;
+}
+
+/*! \brief ADC result of probe (T0_PROBE..T2_PROBE) for one sample of a block
+ */
+
+static unsigned int test_sample(unsigned int block, unsigned char probe, unsigned int sample) {
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+    return (block*37 + probe*300 + sample*13) & 0x3FF; //10 bit
+#else
+    return (block*37 + probe*1000 + sample*13) & 0xFFF; //12 bit
+#endif
+}
+
+/*! \brief Writes one DMA block in the order the ADC delivers it
+ */
+
+static void test_fill(unsigned int *adc_buf, unsigned int block) {
+    unsigned int inc;
+
+    memset(adc_buf, 0, ADC_DMA_BUF_LENGTH*sizeof(adc_buf[0]));
+    for(inc = 0; inc < ADC_BLOCK_LENGTH; inc++) {
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+        adc_buf[inc*ADC_SIMSAM_CHANNELS + 0] = test_sample(block, T0_PROBE, 2*inc); //CH0 doubles up on T0
+        adc_buf[inc*ADC_SIMSAM_CHANNELS + 1] = test_sample(block, T0_PROBE, 2*inc + 1);
+        adc_buf[inc*ADC_SIMSAM_CHANNELS + 2] = test_sample(block, T1_PROBE, inc);
+        adc_buf[inc*ADC_SIMSAM_CHANNELS + 3] = test_sample(block, T2_PROBE, inc);
+#else
+        adc_buf[T0_AN*ADC_BLOCK_LENGTH + inc] = test_sample(block, T0_PROBE, inc); //peripheral indirect: one slot per ANx
+        adc_buf[T1_AN*ADC_BLOCK_LENGTH + inc] = test_sample(block, T1_PROBE, inc);
+        adc_buf[T2_AN*ADC_BLOCK_LENGTH + inc] = test_sample(block, T2_PROBE, inc);
+#endif
+    }
+}
+
+/*! \brief Block sum _DMA1Interrupt() should queue for a probe
+ */
+
+static unsigned int test_expected(unsigned int block, unsigned char probe) {
+    unsigned int sum = 0;
+    unsigned int inc;
+
+#if ADC_ACQ_MODE == ADC_ACQ_SIMSAM
+    if(probe == T0_PROBE) {
+        for(inc = 0; inc < 2*ADC_BLOCK_LENGTH; inc++) {
+            sum += test_sample(block, probe, inc);
+        }
+        return (sum << 1) & 0xFFFF;
+    }
+    for(inc = 0; inc < ADC_BLOCK_LENGTH; inc++) {
+        sum += test_sample(block, probe, inc);
+    }
+    return (sum << 2) & 0xFFFF;
+#else
+    for(inc = 0; inc < ADC_BLOCK_LENGTH; inc++) {
+        sum += test_sample(block, probe, inc);
+    }
+    return sum & 0xFFFF;
+#endif
+}
+
+/*! \brief Lets the DMA controller finish a block and raises the DMA1 interrupt
+ */
+
+static void test_dma_block(unsigned int block) {
+    unsigned int *done = (block & 1) ? dma_adc_buf_b : dma_adc_buf_a; //A first, as the DMA controller does
+
+    test_fill(done, block);
+    test_filling = (block & 1) ? dma_adc_buf_a : dma_adc_buf_b;
+    DMA1_FLAG = 1;
+    _DMA1Interrupt();
+    test_filling = 0;
+    if(DMA1_FLAG != 0) {
+        printf("block %u: DMA1 interrupt flag left set\n", block);
+        test_failures++;
+    }
+}
+
+/*! \brief Pops a record and compares it with the block it came from
+ */
+
+static void test_check(unsigned int block, unsigned long timestamp) {
+    adcRecord record;
+    unsigned char probe;
+
+    if(adc_queue_pop(&record) != 0) {
+        printf("block %u: no record queued\n", block);
+        test_failures++;
+        return;
+    }
+    if(record.timestamp != timestamp) {
+        printf("block %u: timestamp %lu, expected %lu\n", block, record.timestamp, timestamp);
+        test_failures++;
+    }
+    for(probe = 0; probe < ADC_NUM_CHANNELS; probe++) {
+        if((record.accum[probe] & 0xFFFF) != test_expected(block, probe)) {
+            printf("block %u probe %u: sum %u, expected %u\n", block, probe, record.accum[probe] & 0xFFFF, test_expected(block, probe));
+            test_failures++;
+        }
+    }
+}
+
+int main(void) {
+    unsigned int block = 0;
+    unsigned int inc = 0;
+    unsigned long first = 0;
+
+    //one record per block, drained as the main loop would
+    for(block = 0; block < TEST_BLOCKS; block++) {
+        test_dma_block(block);
+        test_check(block, test_now);
+    }
+
+    //main loop stalls: the queue fills and the rest are counted, not overwritten
+    first = test_now + 1;
+    for(inc = 0; inc < ADC_QUEUE_LENGTH + 5; inc++) {
+        test_dma_block(block + inc);
+    }
+    if(adc_queue_overflows != 5) {
+        printf("adc_queue_overflows %u, expected 5\n", adc_queue_overflows);
+        test_failures++;
+    }
+    for(inc = 0; inc < ADC_QUEUE_LENGTH; inc++) {
+        test_check(block + inc, first + inc);
+    }
+    block += ADC_QUEUE_LENGTH + 5;
+
+    //and the ping-pong order survives the dropped blocks
+    test_dma_block(block);
+    test_check(block, test_now);
+
+    printf("%u blocks, %u failures\n", block + 1, test_failures);
+    return test_failures != 0;
+}
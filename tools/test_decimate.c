@@ -0,0 +1,156 @@
+/*! \file test_decimate.c
+    \brief Host test of the decimation filter against a double precision model
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_decimate tools/test_decimate.c decimate.c tools/host/sfr.c -lm
+        ./test_decimate
+
+    Every supported ratio from DECIMATE_RATIO_MIN to DECIMATE_RATIO_MAX is fed
+    a slow sine with noise, a full scale step and both rails. Each output of
+    decimate_push() is compared with a boxcar mean and the binomial FIR
+    {1, 3, 3, 1}/8 computed in double. The MPY/MAC/SACR kernel is emulated
+    by tools/host/p33FJ256GP510A.h. A constant input must come out
+    unchanged, because the FIR has a DC gain of exactly one.
+
+    Exits with 0 when every output is within TEST_TOLERANCE of the model.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "decimate.h"
+
+#define TEST_TOLERANCE  1.0 ///largest allowed difference from the double model (LSB of a block sum)
+#define TEST_BLOCKS     20000 ///block sums fed through each ratio
+
+static const double test_fir[DECIMATE_FIR_TAPS] = {0.125, 0.375, 0.375, 0.125};
+
+static unsigned int test_failures = 0;
+
+/*! \brief Double precision boxcar and FIR with the same priming as decimate_push()
+ */
+
+typedef struct testModel {
+    double sum;
+    unsigned int count;
+    unsigned int blocks;
+    unsigned char primed;
+    double history[DECIMATE_FIR_TAPS];
+}testModel;
+
+static int test_model_push(testModel *pModel, unsigned int adc_accum, double *pOut) {
+    double mean;
+    unsigned char k;
+
+    pModel->sum += adc_accum;
+    if(++pModel->count < pModel->blocks) {
+        return 1;
+    }
+    mean = pModel->sum/pModel->blocks;
+    pModel->sum = 0;
+    pModel->count = 0;
+
+    if(!pModel->primed) {
+        for(k = 0; k < DECIMATE_FIR_TAPS; k++) {
+            pModel->history[k] = mean;
+        }
+        pModel->primed = 1;
+    }
+    for(k = DECIMATE_FIR_TAPS - 1; k > 0; k--) {
+        pModel->history[k] = pModel->history[k-1];
+    }
+    pModel->history[0] = mean;
+
+    *pOut = 0;
+    for(k = 0; k < DECIMATE_FIR_TAPS; k++) {
+        *pOut += test_fir[k]*pModel->history[k];
+    }
+    return 0;
+}
+
+/*! \brief Block sum n of the test signal
+ */
+
+static unsigned int test_input(unsigned int n) {
+    if(n < TEST_BLOCKS/2) {
+        return 32768 + (int)(20000*sin(n*0.003)) + rand()%4000 - 2000; //slow swing with noise
+    }
+    if(n < TEST_BLOCKS*5/8) return 0x0000; //bottom rail
+    if(n < TEST_BLOCKS*6/8) return 0xFFFF; //full scale step to the top rail
+    if(n < TEST_BLOCKS*7/8) return 0x0000; //and back
+    return 12345; //constant
+}
+
+/*! \brief Runs one ratio and returns the largest difference from the model
+ */
+
+static double test_ratio(unsigned int ratio) {
+    decimateStage stage;
+    testModel model = {0};
+    unsigned int n;
+    unsigned int out = 0;
+    unsigned int outputs = 0;
+    double expected = 0;
+    double error = 0;
+    double worst = 0;
+    unsigned char ready;
+
+    if(decimate_init(&stage, ratio) != 0) {
+        printf("ratio %u: rejected\n", ratio);
+        test_failures++;
+        return 0;
+    }
+    model.blocks = ratio/ADC_BLOCK_LENGTH;
+
+    srand(ratio);
+    for(n = 0; n < TEST_BLOCKS; n++) {
+        unsigned int adc_accum = test_input(n);
+
+        ready = decimate_push(&stage, adc_accum, &out);
+        if(ready != test_model_push(&model, adc_accum, &expected)) {
+            printf("ratio %u block %u: output %s\n", ratio, n, ready ? "missing" : "early");
+            test_failures++;
+            return worst;
+        }
+        if(ready != 0) continue;
+
+        outputs++;
+        out &= 0xFFFF; //the host int is wider than the dsPIC's
+        error = fabs(out - expected);
+        if(error > worst) worst = error;
+        if(error > TEST_TOLERANCE) {
+            if(test_failures++ < 10) printf("ratio %u block %u: %u, model %.2f\n", ratio, n, out, expected);
+        }
+        if(n == TEST_BLOCKS - 1 && out != 12345) {
+            printf("ratio %u: constant input came out as %u\n", ratio, out);
+            test_failures++;
+        }
+    }
+    printf("ratio %4u: %4u outputs, worst %.3f LSB\n", ratio, outputs, worst);
+    return worst;
+}
+
+int main(void) {
+    decimateStage stage;
+    unsigned int ratio;
+    double worst = 0;
+    double error;
+
+    for(ratio = DECIMATE_RATIO_MIN; ratio <= DECIMATE_RATIO_MAX; ratio <<= 1) {
+        error = test_ratio(ratio);
+        if(error > worst) worst = error;
+    }
+
+    //ratios the filter cannot run at
+    if(decimate_init(&stage, DECIMATE_RATIO_MIN/2) == 0 || decimate_init(&stage, DECIMATE_RATIO_MAX*2) == 0 || decimate_init(&stage, 48) == 0) {
+        printf("unsupported ratio accepted\n");
+        test_failures++;
+    }
+
+    printf("worst %.3f LSB (limit %.1f), %u failures\n", worst, TEST_TOLERANCE, test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,508 @@
+/*! \file test_log_codec.c
+    \brief Host round trip test and benchmark of the record block payload codec
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -O2 -I tools/host -I . -o test_log_codec tools/test_log_codec.c tools/host/sfr.c -lm
+        ./test_log_codec
+
+    Add -DTEST_CODEC=LOG_CODEC_VARINT (or LOG_CODEC_GORILLA) to test a
+    format other than the LOG_CODEC in defs.h.
+
+    log_codec.c is built in. Sample streams are packed into
+    LOG_PAYLOAD_MAX byte payloads the way logger_task() does it: samples are
+    added until log_encode() refuses one, the payload is finished, decoded
+    and compared with what went in, and the refused sample starts the next
+    payload. The streams are:
+    - random walks, with steps of a few hundredths up to the full 16 bits
+    - full scale steps, between -32768 and 32767 and back
+    - extreme timestamps and temperatures, including the 32 bit timestamp
+      wrap
+    - a week of brewing at 10 samples/s (mash, wort, ambient) with sensor
+      noise, which also reports the bytes per sample
+    - timestamp and temperature steps on each side of every bucket edge of
+      LOG_CODEC_GORILLA (and of every varint length)
+
+    The refusal itself is checked apart from the streams. Payloads of
+    every size up to TEST_ROLLBACK_MAX bytes are fed samples until several
+    have been refused, with cheap samples mixed in after each refusal. A
+    refused sample must leave no trace: the finished payload must be byte
+    for byte what an encoder given only the accepted samples makes, and no
+    byte past the payload size may be touched. A cheap sample that still
+    fits must be taken after a refusal.
+
+    A benchmark then counts host cycles per sample for log_encode() and
+    log_decode(), and for copying the same samples out as raw 10 byte
+    records. The host figures only rank the formats against each other. On
+    the dsPIC, a PROFILE_ISR build reports the worst log_encode() in
+    instruction cycles (Timer1) over the UART.
+
+    Exits with 0 when every sample comes back unchanged.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <p33FJ256GP510A.h>
+#include <test_check.h>
+#include "defs.h"
+#ifdef TEST_CODEC
+#undef LOG_CODEC
+#define LOG_CODEC TEST_CODEC
+#endif
+#include "log_codec.c"
+#include "rtc.h"
+#include "logger.h"
+
+#define TEST_PAYLOADS   2500 ///payloads per random stream
+#define TEST_WEEK       (7UL*24*3600*10) ///samples in a week at 10/s
+#define TEST_TICKS      15625 ///timebase ticks between samples
+#define TEST_BENCH      200000UL ///samples per benchmark pass
+#define TEST_ROLLBACK_MAX   96 ///largest payload size in the rollback check
+#define TEST_REFUSALS   6 ///refused samples per payload in the rollback check
+#define TEST_GUARD      0xA5 ///fill past the end of a payload
+
+
+/* a stream of samples, packed payload by payload */
+typedef struct testStream {
+    logEncoder enc;
+    unsigned char payload[LOG_PAYLOAD_MAX];
+    logSample pending[LOG_PAYLOAD_MAX]; //samples in the payload, at least one byte each
+    unsigned int count;
+    unsigned long samples;
+    unsigned long payloads;
+    unsigned long bytes;
+    const char *name;
+}testStream;
+
+static void test_start(testStream *pStream, const char *name) {
+    memset(pStream, 0, sizeof(*pStream));
+    pStream->name = name;
+    log_encode_init(&pStream->enc, pStream->payload, LOG_PAYLOAD_MAX);
+}
+
+static unsigned char test_same(const logSample *pA, const logSample *pB) {
+    unsigned char inc;
+
+    if(pA->timestamp != pB->timestamp) return 0;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        if(pA->temp[inc] != pB->temp[inc]) return 0;
+    }
+    return 1;
+}
+
+/*! \brief Finishes the payload, decodes it and compares it with the samples put in
+ */
+
+static void test_flush(testStream *pStream) {
+    logDecoder dec;
+    logSample sample;
+    unsigned int length = log_encode_finish(&pStream->enc);
+    unsigned int inc;
+
+    TEST_CHECK(length <= LOG_PAYLOAD_MAX, "%s payload %lu: %u bytes", pStream->name, pStream->payloads, length);
+    log_decode_init(&dec, pStream->payload, length);
+    for(inc = 0; inc < pStream->count; inc++) {
+        if(log_decode(&dec, &sample) != 0) {
+            TEST_CHECK(0, "%s payload %lu: ends after %u of %u samples", pStream->name, pStream->payloads, inc, pStream->count);
+            break;
+        }
+        TEST_CHECK(test_same(&sample, &pStream->pending[inc]), "%s payload %lu sample %u: %lu %d %d %d read back as %lu %d %d %d", pStream->name, pStream->payloads, inc,
+                (unsigned long)pStream->pending[inc].timestamp, pStream->pending[inc].temp[0], pStream->pending[inc].temp[1], pStream->pending[inc].temp[2],
+                (unsigned long)sample.timestamp, sample.temp[0], sample.temp[1], sample.temp[2]);
+    }
+    TEST_CHECK(inc < pStream->count || log_decode(&dec, &sample) == 1, "%s payload %lu: more than %u samples", pStream->name, pStream->payloads, pStream->count);
+
+    pStream->samples += pStream->count;
+    pStream->payloads++;
+    pStream->bytes += length;
+    pStream->count = 0;
+    log_encode_init(&pStream->enc, pStream->payload, LOG_PAYLOAD_MAX);
+}
+
+/*! \brief Adds a sample, starting the next payload when it does not fit
+ */
+
+static void test_add(testStream *pStream, logSample *pSample) {
+    if(log_encode(&pStream->enc, pSample) != 0) {
+        TEST_CHECK(pStream->count != 0, "%s: sample refused by an empty payload", pStream->name);
+        test_flush(pStream);
+        TEST_CHECK(log_encode(&pStream->enc, pSample) == 0, "%s: sample refused by an empty payload", pStream->name);
+    }
+    pStream->pending[pStream->count++] = *pSample;
+}
+
+static void test_end(testStream *pStream) {
+    if(pStream->count != 0) test_flush(pStream);
+    printf("%-8s %8lu samples, %6lu payloads, %5.2f bytes/sample\n", pStream->name, pStream->samples, pStream->payloads, (double)pStream->bytes/pStream->samples);
+}
+
+/*! \brief Random 16 bit temperature, inside the int range of the dsPIC
+ */
+
+static int test_clamp(long value) {
+    if(value < -32768) return -32768;
+    if(value > 32767) return 32767;
+    return (int)value;
+}
+
+/*! \brief Random walks: each stream draws its steps from a wider range
+ */
+
+static void test_walks(void) {
+    static const long range[] = {3, 40, 300, 5000, 65536}; ///largest temperature step per stream
+    testStream stream;
+    logSample sample;
+    unsigned int r;
+    unsigned char inc;
+
+    for(r = 0; r < sizeof(range)/sizeof(range[0]); r++) {
+        srand(r + 1);
+        test_start(&stream, "walk");
+        sample.timestamp = rand();
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            sample.temp[inc] = 2000*inc;
+        }
+        while(stream.payloads < TEST_PAYLOADS) {
+            sample.timestamp += TEST_TICKS + rand() % (2*range[r] + 1) - range[r];
+            sample.timestamp &= 0xFFFFFFFFUL;
+            for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+                sample.temp[inc] = test_clamp(sample.temp[inc] + rand() % (2*range[r] + 1) - range[r]);
+            }
+            test_add(&stream, &sample);
+        }
+        printf("step %5ld ", range[r]);
+        test_end(&stream);
+    }
+}
+
+/*! \brief Full scale steps and jumps of the timestamp
+ */
+
+static void test_steps(void) {
+    testStream stream;
+    logSample sample;
+    unsigned long n;
+    unsigned char inc;
+
+    srand(10);
+    test_start(&stream, "steps");
+    for(n = 0; stream.payloads < TEST_PAYLOADS; n++) {
+        sample.timestamp = (n & 4) ? ((unsigned long)rand() << 16) ^ rand() : n*TEST_TICKS;
+        sample.timestamp &= 0xFFFFFFFFUL;
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            sample.temp[inc] = ((n >> inc) & 1) ? 32767 : -32768;
+        }
+        test_add(&stream, &sample);
+    }
+    test_end(&stream);
+}
+
+/*! \brief Extreme values, including the timestamp wrapping past 0xFFFFFFFF
+ */
+
+static void test_extremes(void) {
+    static const unsigned long timestamp[] = {0, 0xFFFFFFFFUL, 5, 0x80000000UL, 0x7FFFFFFFUL, 0xFFFFFFF0UL, 0x00000010UL, 0xFFFFFFFFUL, 0};
+    static const int temp[] = {-32768, 32767, 0, -1, 1, 32767, -32768, -32767};
+    testStream stream;
+    logSample sample;
+    unsigned int n;
+    unsigned char inc;
+
+    test_start(&stream, "extremes");
+    for(n = 0; n < 2000; n++) {
+        sample.timestamp = timestamp[n % (sizeof(timestamp)/sizeof(timestamp[0]))];
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            sample.temp[inc] = temp[(n + 3*inc) % (sizeof(temp)/sizeof(temp[0]))];
+        }
+        test_add(&stream, &sample);
+    }
+    test_end(&stream);
+}
+
+/*! \brief Steps just inside and just outside every bucket and varint length
+ */
+
+static void test_buckets(void) {
+    static const long edge[] = {1, 7, 8, 9, 63, 64, 65, 127, 128, 129, 255, 256, 257,
+        2047, 2048, 2049, 8191, 8192, 8193, 32767, 65535, 0x7FFFFFFFL}; ///step sizes around the bucket and varint limits
+    testStream stream;
+    logSample sample;
+    unsigned long delta = TEST_TICKS;
+    unsigned int n;
+    unsigned int e;
+    unsigned char inc;
+
+    test_start(&stream, "buckets");
+    sample.timestamp = 0xFFFF0000UL;
+    for(n = 0; n < 8; n++) {
+        for(e = 0; e < sizeof(edge)/sizeof(edge[0]); e++) {
+            //delta-of-delta of +edge, -edge, then back to steady
+            delta = (delta + ((n & 1) ? -edge[e] : edge[e])) & 0xFFFFFFFFUL;
+            sample.timestamp = (sample.timestamp + delta) & 0xFFFFFFFFUL;
+            for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+                sample.temp[inc] = test_clamp(((n >> 1) & 1) ? -edge[e] + 2*inc : edge[e] - 2*inc);
+            }
+            test_add(&stream, &sample);
+            sample.timestamp = (sample.timestamp + delta) & 0xFFFFFFFFUL;
+            for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+                sample.temp[inc] = ((n >> 2) & 1) ? 0 : test_clamp(edge[e] + 1);
+            }
+            test_add(&stream, &sample);
+        }
+    }
+    test_end(&stream);
+}
+
+/*! \brief A sample that is cheap or expensive to add after pPrevious
+ */
+
+static void test_rollback_sample(const logSample *pPrevious, logSample *pSample) {
+    unsigned char inc;
+
+    if(rand() & 1) {
+        *pSample = *pPrevious; //no change: the cheapest sample there is
+        pSample->timestamp = (pSample->timestamp + TEST_TICKS) & 0xFFFFFFFFUL;
+        return;
+    }
+    pSample->timestamp = (pPrevious->timestamp + rand()*(unsigned long)rand()) & 0xFFFFFFFFUL;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        pSample->temp[inc] = (rand() & 1) ? test_clamp(pPrevious->temp[inc] + rand() % 7 - 3) : test_clamp((long)(rand() & 0xFFFF) - 32768);
+    }
+}
+
+/*! \brief Refused samples leave no trace in the payload
+ */
+
+static void test_rollback(void) {
+    static logSample accepted[TEST_ROLLBACK_MAX];
+    unsigned char payload[TEST_ROLLBACK_MAX + 8];
+    unsigned char reference[TEST_ROLLBACK_MAX + 8];
+    logEncoder enc;
+    logDecoder dec;
+    logSample sample;
+    logSample previous;
+    unsigned int max;
+    unsigned int count;
+    unsigned int refusals;
+    unsigned int length;
+    unsigned int inc;
+    unsigned long payloads = 0;
+    unsigned long retaken = 0;
+    unsigned int round;
+
+    srand(3);
+    for(max = 2; max <= TEST_ROLLBACK_MAX; max++) {
+        for(round = 0; round < 200; round++) {
+            memset(payload, TEST_GUARD, sizeof(payload));
+            log_encode_init(&enc, payload, max);
+            count = 0;
+            refusals = 0;
+            previous.timestamp = rand();
+            for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+                previous.temp[inc] = rand() % 10000;
+            }
+            sample = previous;
+            while(refusals < TEST_REFUSALS && count < TEST_ROLLBACK_MAX) {
+                if(log_encode(&enc, &sample) == 0) {
+                    if(refusals != 0) retaken++;
+                    accepted[count++] = sample;
+                    previous = sample;
+                } else {
+                    refusals++;
+                }
+                test_rollback_sample(&previous, &sample);
+            }
+            length = log_encode_finish(&enc);
+            for(inc = max; inc < sizeof(payload); inc++) {
+                TEST_CHECK(payload[inc] == TEST_GUARD, "max %u round %u: byte %u past the payload written", max, round, inc);
+            }
+
+            //the same samples without the refused ones in between
+            memset(reference, TEST_GUARD, sizeof(reference));
+            log_encode_init(&enc, reference, max);
+            for(inc = 0; inc < count; inc++) {
+                TEST_CHECK(log_encode(&enc, &accepted[inc]) == 0, "max %u round %u: sample %u refused without the refusals", max, round, inc);
+            }
+            TEST_CHECK(log_encode_finish(&enc) == length && memcmp(payload, reference, length) == 0,
+                    "max %u round %u: %u samples encode differently after %u refusals", max, round, count, refusals);
+
+            log_decode_init(&dec, payload, length);
+            for(inc = 0; inc < count; inc++) {
+                TEST_CHECK(log_decode(&dec, &sample) == 0 && test_same(&sample, &accepted[inc]), "max %u round %u: sample %u read back wrong", max, round, inc);
+            }
+            TEST_CHECK(log_decode(&dec, &sample) == 1, "max %u round %u: more than %u samples", max, round, count);
+            payloads++;
+        }
+    }
+    TEST_CHECK(retaken != 0, "rollback: no sample was taken after a refusal");
+    printf("rollback: %lu payloads of 2 to %u bytes, %lu samples taken after a refusal\n", payloads, TEST_ROLLBACK_MAX, retaken);
+}
+
+static double test_gauss(void) {
+    double u = (rand() + 1.0)/(RAND_MAX + 2.0);
+    double v = rand()/(RAND_MAX + 1.0);
+
+    return sqrt(-2*log(u))*cos(2*M_PI*v);
+}
+
+/*! \brief A week of brewing, with sensor noise of the given standard deviation (hundredths)
+ */
+
+static void test_week(double noise, testStream *pStream) {
+    logSample sample;
+    unsigned long n;
+    double hours;
+
+    srand(1);
+    test_start(pStream, "week");
+    sample.timestamp = 123456;
+    for(n = 0; n < TEST_WEEK; n++) {
+        hours = n/36000.0;
+        sample.timestamp = (sample.timestamp + TEST_TICKS + rand() % 3 - 1) & 0xFFFFFFFFUL; //main loop jitter
+        sample.temp[0] = (int)lround((65 + 0.05*sin(hours))*100 + test_gauss()*noise); //mash
+        sample.temp[1] = (int)lround((20 + 4*(1 - exp(-hours/20))*exp(-hours/80) + 0.3*sin(hours/3))*100 + test_gauss()*noise); //wort
+        sample.temp[2] = (int)lround((18 + 3*sin(hours*2*M_PI/24))*100 + test_gauss()*noise); //ambient
+        test_add(pStream, &sample);
+    }
+    printf("noise %.1f ", noise);
+    test_end(pStream);
+}
+
+/*! \brief Host cycle counter (the x86 time stamp counter, otherwise clock())
+ */
+
+static unsigned long long test_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return clock();
+#endif
+}
+
+/*! \brief Raw record format: the 10 byte logSample of the dsPIC, little endian
+ */
+
+static unsigned char test_raw(unsigned char *pOut, unsigned int *pLength, logSample *pSample) {
+    unsigned char *p = pOut + *pLength;
+    unsigned char inc;
+
+    if(*pLength + 4 + 2*ADC_NUM_CHANNELS > LOG_PAYLOAD_MAX)
+        return 1;
+    *p++ = pSample->timestamp;
+    *p++ = pSample->timestamp >> 8;
+    *p++ = pSample->timestamp >> 16;
+    *p++ = pSample->timestamp >> 24;
+    for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+        *p++ = pSample->temp[inc];
+        *p++ = pSample->temp[inc] >> 8;
+    }
+    *pLength += 4 + 2*ADC_NUM_CHANNELS;
+    return 0;
+}
+
+/*! \brief Host cycles per sample of the raw record format, log_encode() and log_decode()
+ *
+ *  Runs on a week-like stream. Each figure is the best of 10 passes.
+ */
+
+static void test_benchmark(void) {
+    static logSample samples[TEST_BENCH];
+    unsigned char payload[LOG_PAYLOAD_MAX];
+    logEncoder enc;
+    logDecoder dec;
+    logSample sample;
+    unsigned long n;
+    unsigned long pass;
+    unsigned long decoded;
+    unsigned long bytes = 0;
+    unsigned long raw_bytes = 0;
+    unsigned int length = 0;
+    unsigned char inc;
+    unsigned long long start;
+    unsigned long long raw = ~0ULL;
+    unsigned long long encode = ~0ULL;
+    unsigned long long decode = ~0ULL;
+
+    srand(2);
+    samples[0].timestamp = 1000;
+    for(n = 0; n < TEST_BENCH; n++) {
+        if(n != 0) samples[n].timestamp = samples[n - 1].timestamp + TEST_TICKS + rand() % 3 - 1;
+        for(inc = 0; inc < ADC_NUM_CHANNELS; inc++) {
+            samples[n].temp[inc] = 2000 + 500*inc + n/500 + rand() % 7 - 3;
+        }
+    }
+
+    for(pass = 0; pass < 10; pass++) {
+        start = test_cycles();
+        length = 0;
+        for(n = 0; n < TEST_BENCH; n++) {
+            if(test_raw(payload, &length, &samples[n]) != 0) {
+                if(pass == 0) raw_bytes += length;
+                length = 0;
+                test_raw(payload, &length, &samples[n]);
+            }
+        }
+        start = test_cycles() - start;
+        if(start < raw) raw = start;
+
+        start = test_cycles();
+        log_encode_init(&enc, payload, LOG_PAYLOAD_MAX);
+        for(n = 0; n < TEST_BENCH; n++) {
+            if(log_encode(&enc, &samples[n]) != 0) {
+                if(pass == 0) bytes += log_encode_finish(&enc);
+                log_encode_init(&enc, payload, LOG_PAYLOAD_MAX);
+                log_encode(&enc, &samples[n]);
+            }
+        }
+        start = test_cycles() - start;
+        if(start < encode) encode = start;
+    }
+
+    //decode the last payload over and over
+    length = log_encode_finish(&enc);
+    for(pass = 0; pass < 10; pass++) {
+        decoded = 0;
+        start = test_cycles();
+        while(decoded < TEST_BENCH) {
+            log_decode_init(&dec, payload, length);
+            while(log_decode(&dec, &sample) == 0) decoded++;
+        }
+        start = test_cycles() - start;
+        if(start*TEST_BENCH/decoded < decode) decode = start*TEST_BENCH/decoded;
+    }
+
+    printf("benchmark, host %s per sample: raw records %.1f (%.2f bytes), encode %.1f (%.2f bytes), decode %.1f\n",
+#if defined(__x86_64__) || defined(__i386__)
+            "cycles",
+#else
+            "clock() ticks",
+#endif
+            (double)raw/TEST_BENCH, (double)raw_bytes/TEST_BENCH, (double)encode/TEST_BENCH, (double)bytes/TEST_BENCH, (double)decode/TEST_BENCH);
+}
+
+int main(void) {
+    static testStream week;
+    static const double noise[] = {0.5, 2, 8}; ///sensor noise, hundredths of a degree
+    unsigned int n;
+
+    printf("LOG_CODEC %s, %u byte payloads\n", LOG_CODEC == LOG_CODEC_GORILLA ? "gorilla" : "varint", LOG_PAYLOAD_MAX);
+    test_walks();
+    test_steps();
+    test_extremes();
+    test_buckets();
+    test_rollback();
+    for(n = 0; n < sizeof(noise)/sizeof(noise[0]); n++) {
+        test_week(noise[n], &week);
+    }
+    test_benchmark();
+
+    printf("%u failures\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,222 @@
+/*! \file test_log_ring.c
+    \brief Host test of the lock-free log ring, including a two thread stress run
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -O2 -I tools/host -I . -o test_log_ring tools/test_log_ring.c sram.c tools/host/sfr.c -lpthread
+        ./test_log_ring
+
+    log_ring.c is built in, so the test can start its free-running head and
+    tail counters just below their wrap. Here that is UINT_MAX; on the
+    dsPIC's 16 bit int it is 0xFFFF.
+
+    The first part drives log_ring_push(), log_ring_read() and
+    log_ring_release() from one thread in a random interleaving, across the
+    counter wrap and the ring's own wrap. A plain FIFO model runs alongside.
+    Every sample read back, every refusal, and the log_ring_overflows count
+    must match the model.
+
+    The second part runs a producer thread against a consumer thread, for
+    several producer/consumer speed ratios, again from just below the
+    counter wrap. The consumer reads a block's worth of samples, checks
+    their order and contents, and releases them. Every gap in the sequence
+    must be a dropped sample counted by log_ring_overflows. The host is
+    x86, whose stores are not reordered with each other. That is the
+    ordering the ring relies on, and a dsPIC with the producer in an ISR
+    gives it trivially.
+
+    Exits with 0 when every check passes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <p33FJ256GP510A.h>
+#include <test_check.h>
+#include "defs.h"
+#include "log_ring.c"
+
+#define TEST_STEPS      2000000UL ///single thread operations
+#define TEST_FIFO       (LOG_RING_SIZE/LOG_RECORD_SIZE + 1) ///model capacity (more than the ring holds)
+#define TEST_SAMPLES    1000000UL ///samples the producer thread pushes per run
+#define TEST_READ_AHEAD (BLOCK_SIZE/LOG_RECORD_SIZE) ///samples the consumer reads before releasing
+
+
+/*! \brief Sample number n, with every field derived from n
+ */
+
+static void test_sample(unsigned long n, logSample *pSample) {
+    unsigned char probe;
+
+    memset(pSample, 0, sizeof(*pSample));
+    pSample->timestamp = n;
+    for(probe = 0; probe < ADC_NUM_CHANNELS; probe++) {
+        pSample->temp[probe] = (int)(n*(probe + 3)) ^ 0x5A5A;
+    }
+}
+
+static unsigned char test_matches(unsigned long n, const logSample *pSample) {
+    logSample expected;
+
+    test_sample(n, &expected);
+    return memcmp(&expected, pSample, sizeof(expected)) == 0;
+}
+
+/*! \brief Restarts the ring with both counters at start
+ */
+
+static void test_reset(unsigned int start) {
+    log_ring_head = start;
+    log_ring_tail = start;
+    log_ring_overflows = 0;
+}
+
+/*! \brief Random single thread interleaving against a FIFO model
+ */
+
+static void test_interleaved(unsigned int start) {
+    static unsigned long fifo[TEST_FIFO];
+    unsigned int fifo_head = 0; //model: samples pushed and accepted
+    unsigned int fifo_tail = 0; //model: samples released
+    unsigned int overflows = 0;
+    unsigned long next = 0;
+    unsigned long step;
+    unsigned int count;
+    unsigned int inc;
+    unsigned char wrapped = 0;
+    logSample sample;
+
+    test_reset(start);
+    srand(start);
+    for(step = 0; step < TEST_STEPS; step++) {
+        switch(rand() % 4) {
+        case 0: //push a burst
+        case 1:
+            count = rand() % 8;
+            for(inc = 0; inc < count; inc++) {
+                unsigned char full = (LOG_RING_SIZE - (fifo_head - fifo_tail)*LOG_RECORD_SIZE) < LOG_RECORD_SIZE;
+
+                test_sample(next, &sample);
+                TEST_CHECK(log_ring_push(&sample) == full, "start %u step %lu: push returned %u, model full %u", start, step, !full, full);
+                if(full) {
+                    overflows++;
+                } else {
+                    fifo[fifo_head++ % TEST_FIFO] = next;
+                }
+                next++;
+            }
+            break;
+        case 2: //read ahead, including one past the end
+            count = fifo_head - fifo_tail;
+            for(inc = 0; inc <= count && inc < TEST_READ_AHEAD + 1; inc++) {
+                unsigned char result = log_ring_read(inc*LOG_RECORD_SIZE, &sample);
+
+                if(inc < count) {
+                    TEST_CHECK(result == 0 && test_matches(fifo[(fifo_tail + inc) % TEST_FIFO], &sample), "start %u step %lu: offset %u read back wrong", start, step, inc);
+                } else {
+                    TEST_CHECK(result == 1, "start %u step %lu: read past the newest sample", start, step);
+                }
+            }
+            break;
+        default: //release some, sometimes all
+            if(((step >> 14) & 1) && (rand() & 7) != 0) {
+                break; //every other stretch the card is slow and the ring fills
+            }
+            count = (rand() & 1) ? fifo_head - fifo_tail : rand() % (TEST_READ_AHEAD + 1);
+            if(count > fifo_head - fifo_tail) count = fifo_head - fifo_tail;
+            log_ring_release(count*LOG_RECORD_SIZE);
+            fifo_tail += count;
+            break;
+        }
+        if(log_ring_head < start) wrapped = 1;
+        TEST_CHECK(log_ring_overflows == overflows, "start %u step %lu: log_ring_overflows %u, model %u", start, step, log_ring_overflows, overflows);
+    }
+    TEST_CHECK(wrapped || start == 0, "start %u: the counters never wrapped", start);
+    TEST_CHECK(overflows != 0, "start %u: the ring never filled", start);
+    printf("interleaved from %u: %lu samples, %u dropped\n", start, next, overflows);
+}
+
+/* two thread run */
+static unsigned int test_producer_burst; ///samples the producer pushes before it yields (0 = never)
+static unsigned int test_consumer_delay; ///spin per block, standing in for the SD write
+static volatile unsigned char test_done;
+
+static void test_spin(unsigned int n) {
+    volatile unsigned int inc;
+
+    for(inc = 0; inc < n; inc++);
+}
+
+static void *test_producer(void *arg) {
+    unsigned int seed = 1;
+    unsigned long n;
+    logSample sample;
+
+    (void)arg;
+    for(n = 0; n < TEST_SAMPLES; n++) {
+        test_sample(n, &sample);
+        log_ring_push(&sample);
+        if(test_producer_burst != 0 && (n % test_producer_burst) == 0) sched_yield();
+        if((rand_r(&seed) & 1023) == 0) test_spin(rand_r(&seed) % 20000); //a burst of other work
+    }
+    test_done = 1;
+    return 0;
+}
+
+static void test_threads(unsigned int producer_burst, unsigned int consumer_delay) {
+    pthread_t producer;
+    logSample sample;
+    unsigned long received = 0;
+    unsigned long gaps = 0;
+    unsigned long expected = 0;
+    unsigned int count;
+    unsigned char done;
+
+    test_reset(UINT_MAX - 5*LOG_RING_SIZE/2);
+    test_producer_burst = producer_burst;
+    test_consumer_delay = consumer_delay;
+    test_done = 0;
+    pthread_create(&producer, 0, test_producer, 0);
+
+    do {
+        done = test_done; //once the producer has finished, drain until the ring is empty
+        for(count = 0; count < TEST_READ_AHEAD; count++) {
+            if(log_ring_read(count*LOG_RECORD_SIZE, &sample) != 0) {
+                break;
+            }
+            TEST_CHECK(sample.timestamp >= expected && test_matches(sample.timestamp, &sample), "threads %u/%u: sample %lu corrupt or out of order (expected %lu or later)", producer_burst, consumer_delay, (unsigned long)sample.timestamp, expected);
+            gaps += sample.timestamp - expected;
+            expected = sample.timestamp + 1;
+            received++;
+        }
+        test_spin(test_consumer_delay); //the SD write
+        log_ring_release(count*LOG_RECORD_SIZE);
+        sched_yield();
+    } while(!done || count != 0);
+    pthread_join(producer, 0);
+
+    gaps += TEST_SAMPLES - expected;
+    TEST_CHECK(received + log_ring_overflows == TEST_SAMPLES, "threads %u/%u: %lu received + %u dropped != %lu pushed", producer_burst, consumer_delay, received, log_ring_overflows, TEST_SAMPLES);
+    TEST_CHECK(gaps == log_ring_overflows, "threads %u/%u: %lu missing, log_ring_overflows %u", producer_burst, consumer_delay, gaps, log_ring_overflows);
+    printf("threads, producer burst %3u, consumer delay %5u: %lu received, %u dropped\n", producer_burst, consumer_delay, received, log_ring_overflows);
+}
+
+int main(void) {
+    test_interleaved(0);
+    test_interleaved(UINT_MAX - 100);
+    test_interleaved(UINT_MAX - LOG_RING_SIZE + 3);
+
+    test_threads(1, 0);
+    test_threads(16, 0);
+    test_threads(64, 2000);
+    test_threads(0, 50000); //slow card: the ring must fill and count drops
+
+    TEST_CHECK(log_ring_overflows != 0, "slow consumer run never filled the ring");
+
+    printf("%u failures\n", test_failures);
+    return test_failures != 0;
+}
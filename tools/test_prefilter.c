@@ -0,0 +1,216 @@
+/*! \file test_prefilter.c
+    \brief Host test of the median prefilter and slew limiter
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -O2 -I tools/host -I . -o test_prefilter tools/test_prefilter.c tools/host/sfr.c
+        ./test_prefilter
+
+    Add -DTEST_MEDIAN_N=3 (or 0, 5, 7) to test a window other than the
+    PROBE_MEDIAN_N in defs.h.
+
+    prefilter.c is built in, so its sorting network can be checked directly.
+    The network is compared with qsort() on random windows, and on windows
+    made of a few repeated values. prefilter_push() is then checked on four
+    inputs:
+    - a random sequence, against a running median computed by qsort
+    - bursts of up to (N-1)/2 spikes, which must not move the output at all
+    - a full scale step, which the slew limiter must turn into a ramp
+    - the same step with the limiter off, which must come through whole once
+      the median has seen N/2 + 1 blocks of it
+
+    A benchmark then times prefilter_push() on noisy block sums and reports
+    host cycles per sample (the x86 time stamp counter). Build once for each
+    of N = 3, 5 and 7 to compare the networks; the figures only rank them,
+    the dsPIC cost is its own instruction count.
+
+    Exits with 0 when every check passes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#ifdef TEST_MEDIAN_N
+#undef PROBE_MEDIAN_N
+#define PROBE_MEDIAN_N TEST_MEDIAN_N
+#endif
+#include "prefilter.c"
+
+#define TEST_WINDOWS    200000UL ///random windows compared with qsort()
+#define TEST_SEQUENCE   20000 ///block sums in the running median check
+#define TEST_SLEW       500 ///slew_max for the step check (block sum units per block)
+#define TEST_BENCH      4096 ///block sums per benchmark pass
+#define TEST_PASSES     2000 ///benchmark passes
+
+static unsigned int test_failures = 0;
+
+static int test_compare(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*! \brief Median by qsort() of the last n values before and including seq[i]
+ *
+ *  Values before the start of seq are the first value, as the prefilter primes.
+ */
+
+static unsigned int test_reference(const unsigned int *seq, unsigned int i, unsigned int n) {
+    unsigned int window[PREFILTER_MEDIAN_MAX];
+    unsigned int k;
+
+    if(n == 0) return seq[i];
+    for(k = 0; k < n; k++) {
+        window[k] = (i >= k) ? seq[i - k] : seq[0];
+    }
+    qsort(window, n, sizeof(window[0]), test_compare);
+    return window[n/2];
+}
+
+static void test_network(void) {
+#if PROBE_MEDIAN_N != 0
+    unsigned int window[PROBE_MEDIAN_N];
+    unsigned int sorted[PROBE_MEDIAN_N];
+    unsigned int median;
+    unsigned long n;
+    unsigned int k;
+
+    for(n = 0; n < TEST_WINDOWS; n++) {
+        for(k = 0; k < PROBE_MEDIAN_N; k++) {
+            window[k] = (n & 1) ? (unsigned int)(rand() & 0xFFFF) : (unsigned int)(rand() % 3); //odd: spread, even: ties
+        }
+        memcpy(sorted, window, sizeof(window));
+        median = prefilter_median(window);
+        qsort(sorted, PROBE_MEDIAN_N, sizeof(sorted[0]), test_compare);
+        if(median != sorted[PROBE_MEDIAN_N/2]) {
+            if(test_failures++ < 10) printf("window %lu: network median %u, qsort %u\n", n, median, sorted[PROBE_MEDIAN_N/2]);
+        }
+    }
+#endif
+}
+
+static void test_running(void) {
+    static unsigned int seq[TEST_SEQUENCE];
+    prefilterStage stage;
+    unsigned int value;
+    unsigned int i;
+
+    for(i = 0; i < TEST_SEQUENCE; i++) {
+        seq[i] = rand() & 0xFFFF;
+    }
+    prefilter_init(&stage, 0);
+    for(i = 0; i < TEST_SEQUENCE; i++) {
+        value = prefilter_push(&stage, seq[i]);
+        if(value != test_reference(seq, i, PROBE_MEDIAN_N)) {
+            if(test_failures++ < 10) printf("block %u: %u, running median %u\n", i, value, test_reference(seq, i, PROBE_MEDIAN_N));
+        }
+    }
+}
+
+static void test_spikes(void) {
+    prefilterStage stage;
+    unsigned int burst;
+    unsigned int i;
+    unsigned int value;
+
+    prefilter_init(&stage, 0);
+    for(burst = 1; burst <= PROBE_MEDIAN_N/2; burst++) {
+        for(i = 0; i < PROBE_MEDIAN_N; i++) {
+            prefilter_push(&stage, 30000); //settle
+        }
+        for(i = 0; i < burst + PROBE_MEDIAN_N; i++) {
+            value = prefilter_push(&stage, (i < burst) ? ((i & 1) ? 0 : 0xFFFF) : 30000);
+            if(value != 30000) {
+                if(test_failures++ < 10) printf("burst of %u spikes: output %u on block %u\n", burst, value, i);
+            }
+        }
+    }
+}
+
+static void test_step(unsigned int slew_max) {
+    prefilterStage stage;
+    unsigned int last = 1000;
+    unsigned int value;
+    unsigned int i;
+    unsigned int blocks = 0;
+
+    prefilter_init(&stage, slew_max);
+    prefilter_push(&stage, last);
+    for(i = 0; i < 200; i++) {
+        value = prefilter_push(&stage, 60000);
+        if(slew_max != 0 && (value > last ? value - last : last - value) > slew_max) {
+            if(test_failures++ < 10) printf("slew %u: moved %u to %u in one block\n", slew_max, last, value);
+        }
+        if(value != 60000) blocks = i + 1;
+        last = value;
+    }
+    if(last != 60000) {
+        printf("slew %u: stuck at %u\n", slew_max, last);
+        test_failures++;
+    }
+    //the median holds the old value for N/2 blocks, then the limiter ramps and lands on the last step
+    if(blocks != PROBE_MEDIAN_N/2 + (slew_max ? (59000 + slew_max - 1)/slew_max - 1 : 0)) {
+        printf("slew %u: reached the step after %u blocks\n", slew_max, blocks);
+        test_failures++;
+    }
+}
+
+/*! \brief Host cycles per prefilter_push(), best of TEST_PASSES passes
+ */
+
+static void test_benchmark(void) {
+    static unsigned int seq[TEST_BENCH];
+    prefilterStage stage;
+    volatile unsigned int sink = 0;
+    unsigned long long start;
+    unsigned long long best = ~0ULL;
+    unsigned int pass;
+    unsigned int i;
+
+    for(i = 0; i < TEST_BENCH; i++) {
+        seq[i] = 30000 + rand() % 200 + ((rand() & 63) == 0 ? 20000 : 0); //noise and the odd spike
+    }
+    prefilter_init(&stage, TEST_SLEW);
+    for(pass = 0; pass < TEST_PASSES; pass++) {
+#if defined(__x86_64__) || defined(__i386__)
+        start = __rdtsc();
+#else
+        start = clock();
+#endif
+        for(i = 0; i < TEST_BENCH; i++) {
+            sink += prefilter_push(&stage, seq[i]);
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        start = __rdtsc() - start;
+#else
+        start = clock() - start;
+#endif
+        if(start < best) best = start;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    printf("PROBE_MEDIAN_N %u: %.1f host cycles per sample\n", PROBE_MEDIAN_N, (double)best/TEST_BENCH);
+#else
+    printf("PROBE_MEDIAN_N %u: %.1f ns per sample\n", PROBE_MEDIAN_N, best*1e9/CLOCKS_PER_SEC/TEST_BENCH);
+#endif
+}
+
+int main(void) {
+    srand(1);
+    test_network();
+    test_running();
+    test_spikes();
+    test_step(TEST_SLEW);
+    test_step(0);
+    test_benchmark();
+
+    printf("PROBE_MEDIAN_N %u: %u failures\n", PROBE_MEDIAN_N, test_failures);
+    return test_failures != 0;
+}
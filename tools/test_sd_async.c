@@ -0,0 +1,311 @@
+/*! \file test_sd_async.c
+    \brief Host test of the non-blocking SD block writer against a scripted card
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_sd_async tools/test_sd_async.c sd_async.c tools/host/sfr.c
+        ./test_sd_async
+
+    sd_async.c is linked unchanged. The test supplies the SPI1 byte
+    routines, the SD DMA hooks and the timebase, and behind them a model of
+    an SDHC card in SPI mode. The model parses CMD25, answers with a
+    scripted R1, and takes blocks only inside an open session. It replies
+    to each block with a scripted data response token and then holds DO low
+    for a scripted number of bytes. Only the stop tran token ends the
+    session: as on a real card, deselecting does not, and a CMD25 sent
+    inside a session is taken as data and ignored. Time advances one
+    timebase tick per SPI byte, so each deadline expires after a known
+    number of polls.
+
+    The scenarios cover:
+    - back to back blocks sharing one CMD25
+    - a jump to another address
+    - sd_async_close()
+    - a slow card
+    - every error return, each followed by a block that must be written
+      with a fresh CMD25
+
+    Every sd_async_task() call must stay within SD_POLLS_PER_TASK reads.
+
+    Exits with 0 when every check passes.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <p33FJ256GP510A.h>
+#include <test_check.h>
+#include "defs.h"
+#include "spi_sd.h"
+#include "timebase.h"
+#include "sd_async.h"
+
+#define TEST_FOREVER    0x7FFFFFFFL ///busy or reply delay that outlasts any deadline
+#define TEST_TASKS_MAX  1000000UL ///sd_async_task() calls before a write counts as hung
+
+/* scripted card behaviour */
+static unsigned char test_r1 = 0x00; ///R1 to CMD25 (0x00 = ready)
+static long test_r1_wait = 2; ///0xFF bytes before R1
+static unsigned char test_token = 0xE5; ///data response token (xxx00101 = accepted)
+static long test_busy = 10; ///busy bytes after each accepted block
+static long test_stop_busy = 10; ///busy bytes after the stop tran token
+
+/* card state */
+static unsigned char card_cmd[6];
+static unsigned char card_cmd_length = 0;
+static unsigned char card_session = 0; ///1 between an accepted CMD25 and the stop tran token
+static unsigned long card_addr = 0; ///block the next data token writes
+static int card_reply = -1; ///next byte other than 0xFF the card sends, -1 = none
+static long card_wait = 0; ///0xFF bytes before card_reply
+static long card_busy = 0; ///0x00 bytes the card sends after that
+static unsigned int card_dma = 0; ///SD_DMABusy() calls until the block is out
+
+/* what the card saw */
+static unsigned int card_commands = 0; ///CMD25s received
+static unsigned int card_blocks = 0; ///blocks received
+static unsigned long card_last_addr = 0; ///address of the last block received
+static unsigned char card_last_data = 0; ///first byte of the last block received
+
+static unsigned long test_now = 0; ///timebase_read() ticks, one per SPI byte
+static unsigned int test_reads = 0; ///SPI1Read() calls in the current sd_async_task()
+
+/*! \brief Next byte from the card's DO line
+ */
+
+static unsigned char card_out(void) {
+    unsigned char reply;
+
+    test_now++;
+    if(CS1_PIN) {
+        return 0xFF;
+    }
+    if(card_reply >= 0) {
+        if(card_wait > 0) {
+            card_wait--;
+            return 0xFF;
+        }
+        reply = card_reply;
+        card_reply = -1;
+        return reply;
+    }
+    if(card_busy > 0) {
+        card_busy--;
+        return 0x00;
+    }
+    return 0xFF;
+}
+
+/*! \brief Byte on the card's DI line
+ */
+
+static void card_in(unsigned char data) {
+    if(CS1_PIN) {
+        card_cmd_length = 0; //deselecting does not end a session
+        return;
+    }
+    if(card_session) {
+        if(data == 0xFD) {
+            card_session = 0;
+            card_busy = test_stop_busy;
+        }
+        return;
+    }
+    if(card_cmd_length == 0 && (data & 0xC0) != 0x40) {
+        return; //0xFF between commands
+    }
+    card_cmd[card_cmd_length++] = data;
+    if(card_cmd_length < 6) {
+        return;
+    }
+    card_cmd_length = 0;
+    if(card_cmd[0] != 0x59) {
+        TEST_CHECK(0, "card: unexpected command 0x%02X", card_cmd[0]);
+        return;
+    }
+    card_commands++;
+    card_addr = ((unsigned long)card_cmd[1] << 24) | ((unsigned long)card_cmd[2] << 16) | ((unsigned long)card_cmd[3] << 8) | card_cmd[4];
+    card_session = (test_r1 == 0x00);
+    card_reply = test_r1;
+    card_wait = test_r1_wait;
+}
+
+void SPI1Write(unsigned char data) {
+    card_in(data);
+    (void)card_out();
+}
+
+unsigned char SPI1Read(void) {
+    test_reads++;
+    return card_out();
+}
+
+void SD_StartDMA(unsigned char token, unsigned char *send_ptr) {
+    TEST_CHECK(!CS1_PIN && card_session, "card: block sent outside a CMD25 session");
+    TEST_CHECK(token == 0xFC, "card: data token 0x%02X", token);
+    card_blocks++;
+    card_last_addr = card_addr++;
+    card_last_data = send_ptr[0];
+    card_reply = test_token;
+    card_wait = 1;
+    card_busy = ((test_token & 0x1F) == 0x05) ? test_busy : 0;
+    card_dma = 3;
+}
+
+unsigned char SD_DMABusy(void) {
+    if(card_dma > 0) {
+        card_dma--;
+    }
+    return card_dma != 0;
+}
+
+unsigned long timebase_read(void) {
+    return test_now;
+}
+
+/*! \brief Runs sd_async_task() until the write is DONE or ERROR
+ *
+ * \return sd_async_complete() result, or 0xFF if the writer hung
+ */
+
+static unsigned char test_finish(void) {
+    unsigned long tasks = 0;
+
+    while(sd_async_poll() != SD_ASYNC_DONE && sd_async_poll() != SD_ASYNC_ERROR) {
+        if(tasks++ > TEST_TASKS_MAX) {
+            TEST_CHECK(0, "writer stuck in state %u", sd_async_poll());
+            return 0xFF;
+        }
+        test_reads = 0;
+        sd_async_task();
+        TEST_CHECK(test_reads <= SD_POLLS_PER_TASK, "sd_async_task() polled %u bytes", test_reads);
+    }
+    return sd_async_complete();
+}
+
+/*! \brief Submits one block and checks where and how it was written
+ */
+
+static void test_write(unsigned long addr, unsigned char expect, unsigned int commands) {
+    static unsigned char block[BLOCK_SIZE];
+    unsigned char result;
+
+    block[0] = (unsigned char)addr;
+    TEST_CHECK(sd_async_submit(addr, block) == 0, "block %lu: not accepted", addr);
+    TEST_CHECK(sd_async_submit(addr + 1, block) == 1, "block %lu: second submit accepted while writing", addr);
+    result = test_finish();
+    TEST_CHECK(result == expect, "block %lu: result %u, expected %u", addr, result, expect);
+    TEST_CHECK(card_commands == commands, "block %lu: %u CMD25s, expected %u", addr, card_commands, commands);
+    if(expect == 0) {
+        TEST_CHECK(card_last_addr == addr && card_last_data == (unsigned char)addr, "block %lu: card wrote block %lu", addr, card_last_addr);
+    } else {
+        TEST_CHECK(CS1_PIN == 1, "block %lu: card left selected after error %u", addr, result);
+    }
+}
+
+/*! \brief Ends the session and checks the card saw the stop tran token
+ */
+
+static void test_close(void) {
+    unsigned long tasks = 0;
+
+    sd_async_close();
+    while(sd_async_poll() != SD_ASYNC_IDLE && tasks++ < TEST_TASKS_MAX) {
+        sd_async_task();
+    }
+    TEST_CHECK(sd_async_poll() == SD_ASYNC_IDLE, "close: writer stuck in state %u", sd_async_poll());
+    TEST_CHECK(!card_session && CS1_PIN == 1, "close: session still open");
+}
+
+int main(void) {
+    unsigned int commands = 0;
+    unsigned long addr;
+
+    CS1_PIN = 1;
+
+    //consecutive blocks share one CMD25
+    commands++;
+    for(addr = 100; addr < 108; addr++) {
+        test_write(addr, 0, commands);
+    }
+    //a jump stops the session and opens a new one
+    commands++;
+    test_write(500, 0, commands);
+    test_write(501, 0, commands);
+    test_close();
+
+    //a slow card: programming takes thousands of polls but stays inside the deadline
+    test_busy = SD_WRITE_TIMEOUT_TICKS/2;
+    test_r1_wait = 200;
+    commands++;
+    test_write(600, 0, commands);
+    test_write(601, 0, commands);
+    test_busy = 10;
+    test_r1_wait = 2;
+    test_close();
+
+    //programming overruns the block deadline: the stop tran token still goes out once it ends
+    test_busy = SD_WRITE_TIMEOUT_TICKS + SD_WRITE_TIMEOUT_TICKS/2;
+    commands++;
+    test_write(700, 4, commands);
+    test_busy = 10;
+    commands++; //the session was ended, so the next block starts over
+    test_write(701, 0, commands);
+
+    //card never finishes programming, so only a power cycle ends its session
+    test_busy = TEST_FOREVER;
+    commands++;
+    test_write(710, 4, commands);
+    card_busy = 0;
+    card_session = 0;
+    test_busy = 10;
+    commands++;
+    test_write(711, 0, commands);
+
+    //CRC error token
+    test_token = 0xEB;
+    commands++;
+    test_write(800, 3, commands);
+    test_token = 0xE5;
+    commands++;
+    test_write(801, 0, commands);
+
+    //CMD25 refused
+    test_r1 = 0x04;
+    commands++;
+    test_write(900, 2, commands);
+    test_r1 = 0x00;
+    commands++;
+    test_write(901, 0, commands);
+
+    //no R1 at all, though the card took CMD25
+    test_r1_wait = TEST_FOREVER;
+    commands++;
+    test_write(1000, 2, commands);
+    card_reply = -1;
+    card_wait = 0;
+    test_r1_wait = 2;
+    commands++;
+    test_write(1001, 0, commands);
+
+    //no data response token
+    test_token = 0xFF;
+    commands++;
+    test_write(1100, 2, commands);
+    test_token = 0xE5;
+    commands++;
+    test_write(1101, 0, commands);
+
+    //card stays busy after the stop tran token
+    commands++;
+    test_write(1200, 0, commands);
+    test_stop_busy = TEST_FOREVER;
+    test_write(1300, 5, commands); //the jump fails on the stop, before its CMD25
+    card_busy = 0;
+    test_stop_busy = 10;
+    commands++;
+    test_write(1301, 0, commands);
+    test_close();
+
+    printf("%u blocks written, %u CMD25s, %u failures\n", card_blocks, card_commands, test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,174 @@
+/*! \file test_spi_sd16.c
+    \brief Host test of the 16 bit SD block write against a byte level card model
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_spi_sd16 tools/test_spi_sd16.c tools/host/sfr.c
+        ./test_spi_sd16
+
+    spi_sd16.c is built in with SPI1BUF and SPI1STATbits routed through
+    hooks that play the SPI1 module:
+    - A word written to SPI1BUF is clocked out MSB first on the next status
+      poll. SPIRBF is then set and the card's two reply bytes are left in
+      SPI1BUF.
+    - Any SPI1BUF access clears SPIRBF.
+
+    The card model takes the data token, 512 bytes and the 16 bit CRC. It
+    then answers after a scripted number of 0xFF bytes with a data response
+    token, and holds DO low for a scripted number of busy bytes. Every
+    alignment of the token and of the end of busy within a 16 bit word is
+    run. Rejected blocks, a missing token and a card that never finishes
+    are covered too.
+
+    Exits with 0 when every check passes.
+*/
+
+#include <stdio.h>
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+
+#define TEST_FOREVER    0x7FFFFFFFL ///reply delay or busy that outlasts the timeouts
+#define TEST_PENDING    0x10000UL ///SPI1BUF tag: holds the card's reply, not a word to send
+
+/* scripted card behaviour */
+static long test_delay = 0; ///0xFF bytes between the CRC and the data response token
+static unsigned char test_token = 0xE5; ///data response token (xxx00101 = accepted)
+static long test_busy = 0; ///busy bytes after the token
+
+/* card state */
+static unsigned long card_bytes = 0; ///bytes clocked since the block started
+static unsigned char card_block[BLOCK_SIZE + 3]; ///token, data and CRC as received
+static unsigned long card_busy_end = 0; ///first byte index after the busy signal
+static unsigned int card_mode_errors = 0; ///bytes clocked without the card selected or not in MODE16
+
+/*! \brief One byte exchange with the card
+ */
+
+static unsigned char card_exchange(unsigned char in) {
+    unsigned long n = card_bytes++;
+    unsigned long reply;
+
+    if(CS1_PIN || !SPI1CON1bits.MODE16) {
+        card_mode_errors++;
+    }
+    if(n < sizeof(card_block)) {
+        card_block[n] = in;
+        return 0xFF;
+    }
+    reply = n - sizeof(card_block);
+    if(reply < (unsigned long)test_delay) return 0xFF;
+    if(reply == (unsigned long)test_delay) return test_token;
+    if((test_token & 0x1F) == 0x05 && reply <= (unsigned long)test_delay + test_busy) return 0x00;
+    return 0xFF;
+}
+
+/*! \brief SPI1 shift register: runs a pending SPI1BUF write through the card
+ */
+
+static void test_spi_shift(void) {
+    unsigned int out;
+
+    if(SPI1BUF < TEST_PENDING) {
+        out = card_exchange(SPI1BUF >> 8) << 8;
+        out |= card_exchange(SPI1BUF & 0xFF);
+        SPI1BUF = TEST_PENDING | out;
+        SPI1STATbits.SPIRBF = 1;
+    }
+}
+
+static volatile unsigned int *test_spi1buf(void) {
+    test_spi_shift();
+    SPI1STATbits.SPIRBF = 0; //reading the buffer clears it, a write refills it on the next shift
+    return &SPI1BUF;
+}
+
+static volatile SPI1STATBITS *test_spi1stat(void) {
+    test_spi_shift();
+    return &SPI1STATbits;
+}
+
+#define SPI1BUF         (*test_spi1buf())
+#define SPI1STATbits    (*test_spi1stat())
+#include "spi_sd16.c"
+#undef SPI1BUF
+#undef SPI1STATbits
+
+static unsigned int test_failures = 0;
+
+/*! \brief Writes one block and checks what the card received
+ */
+
+static void test_block(unsigned char expect) {
+    static unsigned char data[BLOCK_SIZE];
+    unsigned int inc;
+    unsigned char result;
+    unsigned char ok = 1;
+
+    for(inc = 0; inc < BLOCK_SIZE; inc++) {
+        data[inc] = (unsigned char)(inc*7 + test_delay + test_busy);
+    }
+    card_bytes = 0;
+    card_mode_errors = 0;
+    card_busy_end = sizeof(card_block) + test_delay + 1 + test_busy;
+    SPI1BUF = TEST_PENDING | 0xFFFF;
+    SPI1STATbits.SPIRBF = 0;
+    CS1_PIN = 1;
+
+    result = SD_WriteMultiBlock16(data);
+
+    if(card_block[0] != 0xFC) ok = 0;
+    for(inc = 0; inc < BLOCK_SIZE; inc++) {
+        if(card_block[inc + 1] != data[inc]) ok = 0;
+    }
+    if(!ok) {
+        printf("delay %ld busy %ld: block corrupted on the way to the card\n", test_delay, test_busy);
+        test_failures++;
+    }
+    if(result != expect) {
+        printf("delay %ld busy %ld token 0x%02X: result %u, expected %u\n", test_delay, test_busy, test_token, result, expect);
+        test_failures++;
+    }
+    if(result == 0 && card_bytes < card_busy_end) {
+        printf("delay %ld busy %ld: returned at byte %lu, card busy until %lu\n", test_delay, test_busy, card_bytes, card_busy_end);
+        test_failures++;
+    }
+    if(card_mode_errors != 0 || CS1_PIN != 1 || SPI1CON1bits.MODE16 != 0) {
+        printf("delay %ld busy %ld: %u bytes outside 16 bit mode, CS1 %u and MODE16 %u after\n", test_delay, test_busy, card_mode_errors, CS1_PIN, SPI1CON1bits.MODE16);
+        test_failures++;
+    }
+}
+
+int main(void) {
+    unsigned int blocks = 0;
+
+    //every alignment of the token and the end of busy, accepted and rejected
+    for(test_delay = 0; test_delay < 6; test_delay++) {
+        for(test_busy = 0; test_busy < 8; test_busy++) {
+            test_token = 0xE5;
+            test_block(0);
+            test_token = 0xEB; //CRC error
+            test_block(3);
+            test_token = 0xED; //write error
+            test_block(3);
+            blocks += 3;
+        }
+    }
+
+    //a long program time
+    test_token = 0xE5;
+    test_delay = 3;
+    test_busy = 50001;
+    test_block(0);
+
+    //no token, and a card that never finishes
+    test_delay = TEST_FOREVER;
+    test_block(2);
+    test_delay = 1;
+    test_busy = TEST_FOREVER;
+    test_block(4);
+    blocks += 3;
+
+    printf("%u blocks, %u failures\n", blocks, test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,219 @@
+/*! \file test_thermistor.c
+    \brief Host test of the thermistor conversion against the original lookup table
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_thermistor tools/test_thermistor.c temp_lookup.c steinhart.c thermocouple.c prefilter.c decimate.c adc_queue.c log_ring.c sram.c tools/host/sfr.c -lm
+        ./test_thermistor
+
+    Runs every one of the 65536 block sums through the inverse table path of
+    temperature.c (built here with THERMISTOR_STEINHART = 0). Each result is
+    compared with the 1 degree C table the firmware used before (100k
+    thermistor, 10k pull-up), linearly interpolated. The old firmware
+    conversion, with its 16 bit arithmetic, is run as well. This shows what
+    its +0.9 C bias was.
+
+    The same sums go through steinhart_convert() with the stock 100k
+    coefficients. They are compared with the old table as well, and the step
+    between neighbouring sums is checked against TEST_STEP.
+
+    The saturated end of both generated tables (a shorted or very hot
+    probe) is checked on its own. The host int is 32 bits, so the scale
+    step from 1/80 C to hundredths is also rerun on int16_t there, as the
+    dsPIC computes it, and every table entry must still come out at or
+    above the table's max rather than wrapping negative.
+
+    Exits with 0 when both paths are within TEST_TOLERANCE of the old table
+    over its 0..200 C range, the table path clamps outside it, the
+    saturated ends read max, and no Steinhart-Hart step is coarser than
+    TEST_STEP.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#undef THERMISTOR_STEINHART
+#define THERMISTOR_STEINHART 0 //the table path of convert_thermistor()
+#include "temperature.c"
+
+#define TEST_TOLERANCE  10 ///largest allowed difference from the old table (hundredths of a degree C)
+#define TEST_STEP       5  ///largest allowed Steinhart-Hart change between neighbouring block sums (hundredths of a degree C)
+#define OLD_LENGTH      201 ///entries of the old table, 0 to 200 C
+
+/* The original lookup_adc_0[]: block sum at 0, 1, 2, ... 200 C (descending) */
+static const unsigned short old_adc[OLD_LENGTH] = {
+    63710, 63611, 63507, 63399, 63287, 63169, 63046, 62919, 62786, 62647,
+    62503, 62354, 62198, 62036, 61869, 61695, 61514, 61327, 61133, 60932,
+    60725, 60510, 60288, 60059, 59822, 59578, 59326, 59067, 58800, 58524,
+    58241, 57950, 57651, 57344, 57028, 56705, 56373, 56034, 55686, 55330,
+    54966, 54594, 54214, 53827, 53431, 53028, 52617, 52199, 51774, 51341,
+    50902, 50455, 50002, 49543, 49077, 48606, 48128, 47645, 47157, 46664,
+    46166, 45663, 45156, 44646, 44131, 43614, 43093, 42570, 42044, 41516,
+    40986, 40455, 39922, 39389, 38855, 38320, 37786, 37252, 36719, 36187,
+    35656, 35126, 34598, 34072, 33548, 33027, 32509, 31994, 31482, 30973,
+    30468, 29967, 29470, 28977, 28489, 28005, 27526, 27051, 26582, 26118,
+    25659, 25205, 24757, 24315, 23878, 23446, 23021, 22601, 22187, 21779,
+    21376, 20980, 20590, 20205, 19827, 19455, 19088, 18728, 18373, 18024,
+    17681, 17344, 17013, 16688, 16368, 16054, 15746, 15443, 15146, 14854,
+    14568, 14287, 14011, 13741, 13475, 13215, 12960, 12710, 12464, 12224,
+    11988, 11757, 11530, 11308, 11091, 10877, 10668, 10463, 10263, 10066,
+    9874, 9685, 9500, 9319, 9142, 8969, 8798, 8632, 8469, 8309,
+    8153, 7999, 7849, 7703, 7559, 7418, 7280, 7145, 7012, 6883,
+    6756, 6632, 6510, 6391, 6274, 6160, 6048, 5939, 5831, 5726,
+    5623, 5522, 5424, 5327, 5232, 5139, 5049, 4960, 4872, 4787,
+    4703, 4621, 4541, 4462, 4385, 4310, 4236, 4163, 4092, 4023,
+    3954
+};
+
+/*! \brief The original conversion from _DMA1Interrupt(), with 16 bit unsigned ints
+ *
+ * \return tenths of a degree C (adc_accum must be inside the table)
+ */
+
+static int old_firmware(unsigned short adc_accum) {
+    unsigned short lookup_count = 0;
+    unsigned short lcd_value_rounded = 0;
+    unsigned short adc_high = 0;
+    unsigned short adc_low = 0;
+    unsigned short range = 0;
+    unsigned short fraction = 0;
+
+    while(adc_accum < old_adc[lookup_count] && lookup_count < OLD_LENGTH) {
+        lookup_count++;
+    }
+    lcd_value_rounded = lookup_count*10;
+    adc_high = old_adc[lookup_count-1];
+    adc_low = old_adc[lookup_count];
+    range = adc_high - adc_low;
+    fraction = 10*(adc_accum - adc_low);
+    fraction = fraction / range;
+    fraction = 9 - fraction;
+    lcd_value_rounded += fraction;
+    return lcd_value_rounded;
+}
+
+/*! \brief The old table, linearly interpolated
+ *
+ * \return degrees C (adc_accum must be inside the table)
+ */
+
+static double old_table(unsigned int adc_accum) {
+    int n = 1;
+
+    while(n < OLD_LENGTH - 1 && adc_accum < old_adc[n]) {
+        n++;
+    }
+    return n - (double)(adc_accum - old_adc[n])/(old_adc[n-1] - old_adc[n]);
+}
+
+/*! \brief The scale step of convert_thermistor() in 16 bit arithmetic
+ */
+
+static int16_t test_scale16(int16_t temp) {
+    if(temp > THERMISTOR_SCALE_MAX) {
+        temp = THERMISTOR_SCALE_MAX;
+    }
+    return (int16_t)(temp + (int16_t)((int16_t)(temp + 2) >> 2));
+}
+
+/*! \brief Saturated table entries must read max, in 16 bit arithmetic too
+ *
+ * \return failures
+ */
+
+static unsigned int test_saturated(const thermistorTable *pTable) {
+    const thermistorTable *saved = probe_tables[T2_PROBE];
+    unsigned int failures = 0;
+    unsigned int adc_accum;
+    unsigned int n;
+    int16_t scaled;
+    int temp;
+
+    for(n = 0; n < (0x10000U >> pTable->shift) + 1; n++) {
+        scaled = test_scale16(pTable->data[n]);
+        if(pTable->data[n] >= THERMISTOR_SCALE_MAX && scaled < pTable->max) {
+            if(failures++ < 10) printf("entry %u (%d): %d in 16 bit arithmetic, below max %d\n", n, pTable->data[n], scaled, pTable->max);
+        }
+        if((pTable->data[n] < 0) != (scaled < 0)) {
+            if(failures++ < 10) printf("entry %u (%d): %d in 16 bit arithmetic, sign flipped\n", n, pTable->data[n], scaled);
+        }
+    }
+
+    probe_tables[T2_PROBE] = pTable;
+    for(adc_accum = 0; pTable->data[adc_accum >> pTable->shift] >= THERMISTOR_SCALE_MAX; adc_accum++) {
+        temp = convert_thermistor(T2_PROBE, adc_accum);
+        if(temp != pTable->max) {
+            if(failures++ < 10) printf("block sum %u: %d at the saturated end, expected max %d\n", adc_accum, temp, pTable->max);
+        }
+    }
+    probe_tables[T2_PROBE] = saved;
+    return failures;
+}
+
+int main(void) {
+    unsigned int adc_accum = 0;
+    unsigned int failures = 0;
+    unsigned int worst_accum = 0;
+    double worst = 0;
+    double worst_firmware = 0;
+    double error = 0;
+    double worst_steinhart = 0;
+    int temp = 0;
+    int previous = 0;
+    int step = 0;
+    int worst_step = 0;
+
+    for(adc_accum = 0; adc_accum <= 0xFFFF; adc_accum++) {
+        temp = convert_thermistor(T1_PROBE, adc_accum);
+
+        if(adc_accum > old_adc[0] || adc_accum < old_adc[OLD_LENGTH-1]) {
+            //outside the old table: the new path clamps to the calibrated range
+            if(temp != (adc_accum > old_adc[0] ? probe_tables[T1_PROBE]->min : probe_tables[T1_PROBE]->max)) {
+                if(failures++ < 10) printf("block sum %u: %d outside the calibrated range is not clamped\n", adc_accum, temp);
+            }
+            continue;
+        }
+
+        error = fabs(temp/100.0 - old_table(adc_accum));
+        if(error > worst) {
+            worst = error;
+            worst_accum = adc_accum;
+        }
+        if(error*100 > TEST_TOLERANCE) {
+            if(failures++ < 10) printf("block sum %u: %.2f C, old table %.2f C\n", adc_accum, temp/100.0, old_table(adc_accum));
+        }
+
+        if(adc_accum < old_adc[0]) { //the old code read past the table at exactly 0 C
+            error = fabs(temp/100.0 - old_firmware(adc_accum)/10.0);
+            if(error > worst_firmware) worst_firmware = error;
+        }
+
+        temp = steinhart_convert(adc_accum, &steinhart_100k);
+        error = fabs(temp/100.0 - old_table(adc_accum));
+        if(error > worst_steinhart) worst_steinhart = error;
+        if(error*100 > TEST_TOLERANCE) {
+            if(failures++ < 10) printf("block sum %u: Steinhart-Hart %.2f C, old table %.2f C\n", adc_accum, temp/100.0, old_table(adc_accum));
+        }
+        if(adc_accum > old_adc[OLD_LENGTH-1]) {
+            step = abs(temp - previous);
+            if(step > worst_step) worst_step = step;
+            if(step > TEST_STEP) {
+                if(failures++ < 10) printf("block sum %u: Steinhart-Hart steps %.2f C\n", adc_accum, step/100.0);
+            }
+        }
+        previous = temp;
+    }
+
+    failures += test_saturated(&thermistor_100k);
+    failures += test_saturated(&thermistor_10k);
+
+    printf("table path vs old table: worst %.3f C at block sum %u (limit %.2f C)\n", worst, worst_accum, TEST_TOLERANCE/100.0);
+    printf("table path vs old firmware: worst %.3f C (its +0.9 C bias and tenths)\n", worst_firmware);
+    printf("Steinhart-Hart vs old table: worst %.3f C, largest step %.2f C (limits %.2f C, %.2f C)\n", worst_steinhart, worst_step/100.0, TEST_TOLERANCE/100.0, TEST_STEP/100.0);
+    printf("%u failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,111 @@
+/*! \file test_thermocouple.c
+    \brief Host test of the type K conversion against the NIST forward polynomial
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -I tools/host -I . -o test_thermocouple tools/test_thermocouple.c thermocouple.c tools/host/sfr.c -lm
+        ./test_thermocouple
+
+    For a set of board (cold junction) temperatures, every 0.1 C from 0 C
+    to TEST_T_MAX is turned into the block sum the AD8495 produces. The
+    thermocouple EMF comes from the NIST ITS-90 type K reference polynomial
+    (the forward one, independent of the inverse table in thermocouple.c).
+    The AD8495 adds a linear 40.85 uV/C cold junction term and a gain of
+    122.4. Each block sum is converted with thermocouple_cj_offset() and
+    thermocouple_convert(), and the result is compared with the input
+    temperature. The AD8495's own 5 mV/C reading is worked out as well, for
+    comparison.
+
+    Exits with 0 when every reading is within TEST_TOLERANCE and the clamps
+    hold at both ends of the block sum range.
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include <p33FJ256GP510A.h>
+#include "defs.h"
+#include "thermocouple.h"
+
+#define TEST_TOLERANCE  0.10 ///largest allowed error (degrees C)
+#define TEST_T_MAX      320.0 ///hottest temperature checked (degrees C)
+#define TEST_UV_COUNT   (2.5e6/(65536*122.4)) ///thermocouple uV per block sum count
+#define TEST_CJ_SLOPE   (5000/122.4) ///AD8495 cold junction compensation, uV/C at its input
+
+/* NIST ITS-90 type K, E(t) in mV */
+static const double test_neg[] = {0.0, 0.394501280250e-1, 0.236223735980e-4, -0.328589067840e-6,
+    -0.499048287770e-8, -0.675090591730e-10, -0.574103274280e-12, -0.310888728940e-14,
+    -0.104516093650e-16, -0.198892668780e-19, -0.163226974860e-22};
+static const double test_pos[] = {-0.176004136860e-1, 0.389212049750e-1, 0.185587700320e-4,
+    -0.994575928740e-7, 0.318409457190e-9, -0.560728448890e-12, 0.560750590590e-15,
+    -0.320207200030e-18, 0.971511471520e-22, -0.121047212750e-25};
+
+static const double test_cj[] = {15.0, 17.3, 25.0, 35.0}; ///board temperatures checked (degrees C)
+
+/*! \brief Type K EMF
+ *
+ * \return uV at temperature t (degrees C)
+ */
+
+static double test_emf(double t) {
+    const double *c = (t < 0) ? test_neg : test_pos;
+    unsigned int n = (t < 0) ? sizeof(test_neg)/sizeof(test_neg[0]) : sizeof(test_pos)/sizeof(test_pos[0]);
+    double e = 0;
+    double power = 1;
+    unsigned int k;
+
+    for(k = 0; k < n; k++) {
+        e += c[k]*power;
+        power *= t;
+    }
+    if(t >= 0) {
+        e += 0.118597600000*exp(-0.118343200000e-3*(t - 126.9686)*(t - 126.9686));
+    }
+    return e*1000;
+}
+
+int main(void) {
+    unsigned int failures = 0;
+    unsigned int i;
+    unsigned int n;
+    unsigned int adc_accum;
+    int cj_offset;
+    int temp;
+    double t;
+    double error;
+    double worst = 0;
+    double worst_linear = 0;
+
+    for(i = 0; i < sizeof(test_cj)/sizeof(test_cj[0]); i++) {
+        cj_offset = thermocouple_cj_offset((int)(test_cj[i]*100 + 0.5));
+        for(n = 0; n*0.1 <= TEST_T_MAX; n++) {
+            t = n*0.1;
+            adc_accum = (unsigned int)((test_emf(t) - test_emf(test_cj[i]) + TEST_CJ_SLOPE*test_cj[i])/TEST_UV_COUNT);
+            temp = thermocouple_convert(adc_accum, cj_offset);
+
+            error = fabs(temp/100.0 - t);
+            if(error > worst) worst = error;
+            if(error > TEST_TOLERANCE) {
+                if(failures++ < 10) printf("%.1f C at cold junction %.1f C: read %.2f C\n", t, test_cj[i], temp/100.0);
+            }
+            error = fabs(adc_accum*TEST_UV_COUNT/TEST_CJ_SLOPE - t);
+            if(error > worst_linear) worst_linear = error;
+        }
+    }
+
+    //clamps at both ends of the block sum range
+    temp = thermocouple_convert(0, thermocouple_cj_offset(THERMOCOUPLE_CJ_MIN));
+    if(temp < 0) {
+        printf("block sum 0 at %d: %d below 0 C\n", THERMOCOUPLE_CJ_MIN, temp);
+        failures++;
+    }
+    temp = thermocouple_convert(0xFFFF, thermocouple_cj_offset(THERMOCOUPLE_CJ_MAX));
+    if(temp != THERMOCOUPLE_TEMP_MAX) {
+        printf("block sum 0xFFFF at %d: %d, expected THERMOCOUPLE_TEMP_MAX\n", THERMOCOUPLE_CJ_MAX, temp);
+        failures++;
+    }
+
+    printf("worst %.3f C (limit %.2f C), AD8495 5 mV/C reading worst %.2f C\n", worst, TEST_TOLERANCE, worst_linear);
+    printf("%u failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,234 @@
+/*! \file thermgen.c
+    \brief Host tool that generates the thermistor lookup tables (temp_lookup.c/.h)
+
+    Build and run on the development PC, not on the dsPIC:
+
+        gcc -o thermgen tools/thermgen.c -lm
+        ./thermgen temp_lookup <probe> [<probe> ...]
+
+    Each <probe> is a colon separated list that starts with the table name:
+
+        name:beta=<B>:r25=<ohms>[:<options>]        Beta model
+        name:sh=<A>,<B>,<C>[:<options>]             Steinhart-Hart model
+
+    options:
+        rpullup=<ohms>  divider resistor between the ADC reference and the
+                        thermistor (default 10000)
+        vratio=<Vs/Vref> divider supply voltage over the ADC reference
+                        voltage (default 1.0, i.e. ratiometric)
+        shift=<bits>    accumulator bits per table step, 4..12 (default 8,
+                        i.e. 257 entries)
+        min=<C>         lowest calibrated temperature (default 0)
+        max=<C>         highest calibrated temperature (default 200)
+
+    The tables are inverse tables indexed directly by the ADC block sum (the
+    sum of 16 12-bit samples, full scale 2^16): entry n holds the temperature
+    at adc_accum = n << shift in 1/80 degree C. They are declared const with
+    space(auto_psv) so they stay in program flash and are read through the
+    PSV window instead of taking data RAM.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ACCUM_FULL_SCALE    65536.0 ///block sum full scale (16 x 12 bit)
+#define TABLE_FRAC          3       ///entries are tenths of a degree C << 3
+#define TABLE_SCALE         80.0    ///entries per degree C (10 << TABLE_FRAC)
+#define KELVIN              273.15
+#define TEMP_HIGHEST        400.0   ///table entries saturate here (C)
+#define TEMP_LOWEST         -200.0
+#define MAX_PROBES          8
+
+typedef struct probeSpec {
+    char name[32];
+    int model_sh;       //1 = Steinhart-Hart, 0 = Beta
+    double beta;
+    double r25;
+    double sh[3];
+    double rpullup;
+    double vratio;
+    int shift;
+    double min;
+    double max;
+} probeSpec;
+
+/*! \brief Thermistor temperature (C) for a resistance (ohms)
+ *
+ *  Saturates to TEMP_HIGHEST/TEMP_LOWEST where the model stops making sense
+ *  (near short or open circuit), so the table stays monotonic.
+ */
+
+static double probe_temperature(const probeSpec *p, double r) {
+    double l = log(r);
+    double inverse = 0;
+
+    if(p->model_sh) {
+        inverse = p->sh[0] + p->sh[1]*l + p->sh[2]*l*l*l;
+    } else {
+        inverse = 1.0/(25.0 + KELVIN) + log(r/p->r25)/p->beta;
+    }
+
+    if(inverse <= 1.0/(TEMP_HIGHEST + KELVIN)) {
+        return TEMP_HIGHEST;
+    }
+    if(inverse >= 1.0/(TEMP_LOWEST + KELVIN)) {
+        return TEMP_LOWEST;
+    }
+    return 1.0/inverse - KELVIN;
+}
+
+/*! \brief Table entry (1/80 C) for a block sum
+ */
+
+static int table_entry(const probeSpec *p, double accum) {
+    double x = accum/ACCUM_FULL_SCALE; //ADC reading relative to Vref
+    double t = 0;
+
+    /* x = vratio * Rt/(Rt + Rpullup); keep away from the ends where the
+     * resistance goes to zero or infinity */
+    if(x < 0.5/ACCUM_FULL_SCALE) {
+        x = 0.5/ACCUM_FULL_SCALE;
+    }
+    if(x > p->vratio*(1.0 - 0.5/ACCUM_FULL_SCALE)) {
+        x = p->vratio*(1.0 - 0.5/ACCUM_FULL_SCALE);
+    }
+    t = probe_temperature(p, p->rpullup*x/(p->vratio - x))*TABLE_SCALE;
+
+    return (int)floor(t + 0.5);
+}
+
+/*! \brief Parses one probe specification
+ */
+
+static int parse_probe(char *arg, probeSpec *p) {
+    char *field;
+
+    memset(p, 0, sizeof(*p));
+    p->rpullup = 10000.0;
+    p->vratio = 1.0;
+    p->shift = 8;
+    p->min = 0.0;
+    p->max = 200.0;
+    p->model_sh = -1;
+
+    field = strtok(arg, ":");
+    if(field == NULL || strlen(field) >= sizeof(p->name)) {
+        return 1;
+    }
+    strcpy(p->name, field);
+
+    while((field = strtok(NULL, ":")) != NULL) {
+        if(strncmp(field, "beta=", 5) == 0) {
+            p->beta = atof(field+5);
+            p->model_sh = 0;
+        } else if(strncmp(field, "r25=", 4) == 0) {
+            p->r25 = atof(field+4);
+        } else if(strncmp(field, "sh=", 3) == 0) {
+            if(sscanf(field+3, "%lf,%lf,%lf", &p->sh[0], &p->sh[1], &p->sh[2]) != 3) {
+                return 1;
+            }
+            p->model_sh = 1;
+        } else if(strncmp(field, "rpullup=", 8) == 0) {
+            p->rpullup = atof(field+8);
+        } else if(strncmp(field, "vratio=", 7) == 0) {
+            p->vratio = atof(field+7);
+        } else if(strncmp(field, "shift=", 6) == 0) {
+            p->shift = atoi(field+6);
+        } else if(strncmp(field, "min=", 4) == 0) {
+            p->min = atof(field+4);
+        } else if(strncmp(field, "max=", 4) == 0) {
+            p->max = atof(field+4);
+        } else {
+            return 1;
+        }
+    }
+
+    if(p->model_sh < 0 || (p->model_sh == 0 && (p->beta <= 0 || p->r25 <= 0))) {
+        return 1;
+    }
+    if(p->shift < 4 || p->shift > 12 || p->rpullup <= 0 || p->vratio <= 0 || p->min >= p->max) {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    probeSpec probes[MAX_PROBES];
+    char spec[256];
+    char path[256];
+    FILE *out;
+    int n = 0;
+    int i = 0;
+    int length = 0;
+
+    if(argc < 3 || argc - 2 > MAX_PROBES) {
+        fprintf(stderr, "usage: %s <output basename> <probe> [<probe> ...]\n", argv[0]);
+        return 1;
+    }
+    for(n = 0; n < argc - 2; n++) {
+        strncpy(spec, argv[n+2], sizeof(spec) - 1); //parse_probe() splits its argument in place
+        spec[sizeof(spec) - 1] = 0;
+        if(parse_probe(spec, &probes[n]) != 0) {
+            fprintf(stderr, "%s: bad probe specification '%s'\n", argv[0], argv[n+2]);
+            return 1;
+        }
+    }
+
+    /* header */
+    snprintf(path, sizeof(path), "%s.h", argv[1]);
+    out = fopen(path, "w");
+    if(out == NULL) {
+        perror(path);
+        return 1;
+    }
+    fprintf(out, "/* Generated by tools/thermgen.c -- do not edit, regenerate instead */\n\n");
+    fprintf(out, "#ifndef INC_TEMP_LOOKUP_H\n#define INC_TEMP_LOOKUP_H\n\n");
+    fprintf(out, "#define THERMISTOR_TABLE_FRAC %d ///table entries are tenths of a degree C << %d\n\n", TABLE_FRAC, TABLE_FRAC);
+    fprintf(out, "typedef struct thermistorTable {\n");
+    fprintf(out, "    const int *data; //temperature at adc_accum = n << shift (1/80 C)\n");
+    fprintf(out, "    unsigned char shift; //accumulator bits per table step\n");
+    fprintf(out, "    int min; //lowest calibrated temperature (hundredths of a degree C)\n");
+    fprintf(out, "    int max; //highest calibrated temperature (hundredths of a degree C)\n");
+    fprintf(out, "}thermistorTable;\n\n");
+    for(n = 0; n < argc - 2; n++) {
+        fprintf(out, "extern const thermistorTable thermistor_%s;\n", probes[n].name);
+    }
+    fprintf(out, "\n#endif\n");
+    fclose(out);
+
+    /* tables */
+    snprintf(path, sizeof(path), "%s.c", argv[1]);
+    out = fopen(path, "w");
+    if(out == NULL) {
+        perror(path);
+        return 1;
+    }
+    fprintf(out, "/*! \\file temp_lookup.c\n    \\brief Contains lookup tables for temperatures\n\n");
+    fprintf(out, "    Generated by tools/thermgen.c -- do not edit, regenerate instead:\n\n");
+    fprintf(out, "        thermgen %s", argv[1]);
+    for(i = 2; i < argc; i++) {
+        fprintf(out, " \\\n            %s", argv[i]);
+    }
+    fprintf(out, "\n*/\n\n#include \"temp_lookup.h\"\n");
+
+    for(n = 0; n < argc - 2; n++) {
+        probeSpec *p = &probes[n];
+
+        length = (65536 >> p->shift) + 1;
+        fprintf(out, "\n/* %s: %d entries, %g to %g C */\n", p->name, length, p->min, p->max);
+        fprintf(out, "static const int thermistor_%s_data[%d] __attribute__((space(auto_psv))) = {\n", p->name, length);
+        for(i = 0; i < length; i++) {
+            fprintf(out, "%s%6d%s", (i % 8) == 0 ? "    " : " ",
+                    table_entry(p, (double)((long)i << p->shift)),
+                    i == length - 1 ? "\n" : ((i % 8) == 7 ? ",\n" : ","));
+        }
+        fprintf(out, "};\n\n");
+        fprintf(out, "const thermistorTable thermistor_%s = {thermistor_%s_data, %d, %d, %d};\n",
+                p->name, p->name, p->shift, (int)floor(p->min*100.0 + 0.5), (int)floor(p->max*100.0 + 0.5));
+    }
+    fclose(out);
+
+    return 0;
+}
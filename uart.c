@@ -65,4 +65,29 @@ unsigned char uart_write_string(unsigned char *string, unsigned char length) {
     uart_write_byte('\n');
     
     return 0;
-}
\ No newline at end of file
+}
+
+/*! \brief Writes a label followed by an unsigned decimal value and a newline
+ */
+
+unsigned char uart_write_value(unsigned char *label, unsigned char length, unsigned int value) {
+    unsigned char digits[5];
+    unsigned char inc = 0;
+
+    for(inc = 0; inc < length; inc++) {
+        uart_write_byte(label[inc]);
+    }
+
+    inc = 0;
+    do {
+        digits[inc++] = (value % 10) + 48;
+        value /= 10;
+    } while(value != 0);
+
+    while(inc > 0) {
+        uart_write_byte(digits[--inc]);
+    }
+    uart_write_byte('\n');
+
+    return 0;
+}
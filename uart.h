@@ -5,6 +5,7 @@
 unsigned char uart_init(); 
 unsigned char uart_write_byte(unsigned char byte);
 unsigned char uart_write_string(unsigned char *string, unsigned char length);
+unsigned char uart_write_value(unsigned char *label, unsigned char length, unsigned int value);
 
 
 #endif
\ No newline at end of file